@@ -0,0 +1,317 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+  Project Name:
+
+     BeDIS
+
+  File Name:
+
+     bench_mempool.c
+
+  File Description:
+
+     This file contains the program measuring the cost of allocating and
+     freeing the slots of a memory pool. Each case is run by passing its name,
+     or all of them if no name is passed.
+
+  Version:
+
+     2.0, 20201016
+
+  Abstract:
+
+     BeDIS uses LBeacons to deliver 3D coordinates and textual descriptions of
+     their locations to users' devices. Basically, a LBeacon is an inexpensive,
+     Bluetooth Smart Ready device. The 3D coordinates and location description
+     of every LBeacon are retrieved from BeDIS (Building/environment Data and
+     Information System) and stored locally during deployment and maintenance
+     times. Once initialized, each LBeacon broadcasts its coordinates and
+     location description to Bluetooth enabled user devices within its coverage
+     area.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "Mempool.h"
+
+/* The size in bytes of the slots, about that of a ScannedDevice */
+#define BENCH_SLOT_SIZE 72
+
+/* The number of slots added by each expansion */
+#define BENCH_SLOTS_PER_EXPANSION 2048
+
+/* The number of alloc/free pairs timed in each run */
+#define BENCH_NUMBER_PAIRS 10000000
+
+/* The number of allocated slots freed and allocated again in turn. They are
+   spread evenly over all the slabs. */
+#define BENCH_NUMBER_ROTATED_SLOTS 64
+
+/* The number of alloc/free pairs timed in each thread of the contention 
+   case */
+#define BENCH_NUMBER_PAIRS_PER_THREAD 2000000
+
+/* The number of slots each thread holds at a time in the contention case */
+#define BENCH_SLOTS_PER_BATCH 8
+
+/* The maximum number of threads of the contention case */
+#define BENCH_MAX_NUMBER_THREADS 8
+
+/* The number of alloc/free pairs timed for each slot size and zeroing 
+   policy */
+#define BENCH_NUMBER_ZEROING_PAIRS 1000000
+
+/* The number of slots added by each expansion in the zeroing case, fewer 
+   than usual to keep the pools of large slots small */
+#define BENCH_ZEROING_SLOTS_PER_EXPANSION 256
+
+/* Struct for a way of sharing a memory pool between threads */
+typedef struct BenchPoolMode {
+
+    char *name;
+
+    /* The function enabling the mode on a memory pool, or NULL for the pool
+       under the global mem_lock */
+    int (*enable)(Memory_Pool *mp);
+
+} BenchPoolMode;
+
+/* Struct for a case of the benchmark */
+typedef struct BenchCase {
+
+    char *name;
+
+    void (*run)(void);
+
+} BenchCase;
+
+
+/* A static function returning the time in nanoseconds from CLOCK_MONOTONIC */
+static double get_time_in_ns(){
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+
+/* A static function timing alloc/free pairs on a memory pool expanded the 
+   input number of times. All the slots are allocated, and each pair frees one
+   of the rotated slots and allocates a slot again, so that the frees hit 
+   every slab. */
+static void bench_expansions(int number_expansions){
+
+    Memory_Pool mp;
+    void **slots;
+    int number_slots = number_expansions * BENCH_SLOTS_PER_EXPANSION;
+    int stride = number_slots / BENCH_NUMBER_ROTATED_SLOTS;
+    int i;
+    double start_time;
+    double elapsed_time;
+
+    mp_init(&mp, BENCH_SLOT_SIZE, BENCH_SLOTS_PER_EXPANSION);
+    mp_set_zeroing(&mp, MEMORY_POOL_ZEROING_NONE);
+
+    slots = malloc(number_slots * sizeof(void *));
+
+    for(i = 0; i < number_slots; i++)
+        slots[i] = mp_alloc(&mp);
+
+    start_time = get_time_in_ns();
+
+    for(i = 0; i < BENCH_NUMBER_PAIRS; i++){
+
+        void **slot = &slots[(i % BENCH_NUMBER_ROTATED_SLOTS) * stride];
+
+        mp_free(&mp, *slot);
+        *slot = mp_alloc(&mp);
+    }
+
+    elapsed_time = get_time_in_ns() - start_time;
+
+    printf("expansion: expansions=[%d] ns_per_pair=[%.1f]\n",
+           number_expansions, elapsed_time / BENCH_NUMBER_PAIRS);
+
+    for(i = 0; i < number_slots; i++)
+        mp_free(&mp, slots[i]);
+
+    free(slots);
+    mp_destroy(&mp);
+}
+
+
+/* A static function comparing the cost of alloc/free pairs with 1, 4 and 
+   MAX_EXP_TIME expansions, which should be the same */
+static void bench_expansion(){
+
+    bench_expansions(1);
+    bench_expansions(4);
+    bench_expansions(MAX_EXP_TIME);
+}
+
+
+/* A static function allocating and freeing batches of slots of the input 
+   memory pool. It is the body of the threads of the contention case. */
+static void *bench_contention_thread(void *mp){
+
+    void *slots[BENCH_SLOTS_PER_BATCH];
+    int i;
+    int j;
+
+    for(i = 0; i < BENCH_NUMBER_PAIRS_PER_THREAD; i += BENCH_SLOTS_PER_BATCH){
+
+        for(j = 0; j < BENCH_SLOTS_PER_BATCH; j++)
+            slots[j] = mp_alloc(mp);
+
+        for(j = 0; j < BENCH_SLOTS_PER_BATCH; j++)
+            mp_free(mp, slots[j]);
+    }
+
+    return NULL;
+}
+
+
+/* The ways of sharing a memory pool compared by the contention case */
+static BenchPoolMode bench_pool_modes[] = {
+    {"mutex", NULL},
+    {"thread_cache", mp_enable_thread_cache},
+    {"lock_free", mp_enable_lock_free}
+};
+
+
+/* A static function timing alloc/free pairs made by 1 to 
+   BENCH_MAX_NUMBER_THREADS threads sharing a memory pool, in each way of 
+   sharing it */
+static void bench_contention(){
+
+    Memory_Pool mp;
+    pthread_t threads[BENCH_MAX_NUMBER_THREADS];
+    size_t mode;
+    int number_threads;
+    int i;
+    double start_time;
+    double elapsed_time;
+
+    for(mode = 0; 
+        mode < sizeof(bench_pool_modes) / sizeof(bench_pool_modes[0]); 
+        mode++){
+
+        for(number_threads = 1; 
+            number_threads <= BENCH_MAX_NUMBER_THREADS; 
+            number_threads *= 2){
+
+            mp_init(&mp, BENCH_SLOT_SIZE, BENCH_SLOTS_PER_EXPANSION);
+            mp_set_zeroing(&mp, MEMORY_POOL_ZEROING_NONE);
+
+            if(bench_pool_modes[mode].enable != NULL)
+                bench_pool_modes[mode].enable(&mp);
+
+            start_time = get_time_in_ns();
+
+            for(i = 0; i < number_threads; i++){
+                pthread_create(&threads[i], NULL, 
+                               bench_contention_thread, &mp);
+            }
+
+            for(i = 0; i < number_threads; i++)
+                pthread_join(threads[i], NULL);
+
+            elapsed_time = get_time_in_ns() - start_time;
+
+            printf("contention: mode=[%s] threads=[%d] "
+                   "million_pairs_per_sec=[%.2f]\n",
+                   bench_pool_modes[mode].name, number_threads,
+                   (double) number_threads * BENCH_NUMBER_PAIRS_PER_THREAD /
+                   elapsed_time * 1e3);
+
+            mp_destroy(&mp);
+        }
+    }
+}
+
+
+/* A static function timing alloc/free pairs with each zeroing policy, for 
+   slots from the size of a small struct to that of a BufferNode of BeDIS */
+static void bench_zeroing(){
+
+    Memory_Pool mp;
+    size_t sizes[] = {64, 256, 1024, 8192};
+    MemoryPoolZeroing zeroings[] = {MEMORY_POOL_ZEROING_NONE,
+                                    MEMORY_POOL_ZEROING_ON_ALLOC,
+                                    MEMORY_POOL_ZEROING_POISON};
+    char *zeroing_names[] = {"none", "on_alloc", "poison"};
+    size_t size;
+    size_t zeroing;
+    void *slot;
+    int i;
+    double start_time;
+    double elapsed_time;
+
+    for(size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++){
+
+        for(zeroing = 0; 
+            zeroing < sizeof(zeroings) / sizeof(zeroings[0]); 
+            zeroing++){
+
+            mp_init(&mp, sizes[size], BENCH_ZEROING_SLOTS_PER_EXPANSION);
+            mp_set_zeroing(&mp, zeroings[zeroing]);
+
+            start_time = get_time_in_ns();
+
+            for(i = 0; i < BENCH_NUMBER_ZEROING_PAIRS; i++){
+
+                slot = mp_alloc(&mp);
+
+                /* Write the slot as a caller would */
+                *(volatile char *) slot = 1;
+
+                mp_free(&mp, slot);
+            }
+
+            elapsed_time = get_time_in_ns() - start_time;
+
+            printf("zeroing: slot_size=[%zu] policy=[%s] ns_per_pair=[%.1f]\n",
+                   sizes[size], zeroing_names[zeroing],
+                   elapsed_time / BENCH_NUMBER_ZEROING_PAIRS);
+
+            mp_destroy(&mp);
+        }
+    }
+}
+
+
+/* The cases of the benchmark */
+static BenchCase bench_cases[] = {
+    {"expansion", bench_expansion},
+    {"contention", bench_contention},
+    {"zeroing", bench_zeroing}
+};
+
+
+int main(int argc, char **argv){
+
+    size_t i;
+    int is_found = 0;
+
+    for(i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++){
+
+        if(argc < 2 || strcmp(argv[1], bench_cases[i].name) == 0){
+            bench_cases[i].run();
+            is_found = 1;
+        }
+    }
+
+    if(!is_found){
+        fprintf(stderr, "Unknown case [%s]\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
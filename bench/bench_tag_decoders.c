@@ -0,0 +1,133 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+  Project Name:
+
+     BeDIS
+
+  File Name:
+
+     bench_tag_decoders.c
+
+  File Description:
+
+     This file contains the program measuring the cost of decoding the 0xFF
+     field of BLE payload with each entry of the tag_decoders table. The 
+     program of LBeacon is included, so that the static decoders are called
+     as the examining threads call them.
+
+  Version:
+
+     2.0, 20201016
+
+  Abstract:
+
+     BeDIS uses LBeacons to deliver 3D coordinates and textual descriptions of
+     their locations to users' devices. Basically, a LBeacon is an inexpensive,
+     Bluetooth Smart Ready device. The 3D coordinates and location description
+     of every LBeacon are retrieved from BeDIS (Building/environment Data and
+     Information System) and stored locally during deployment and maintenance
+     times. Once initialized, each LBeacon broadcasts its coordinates and
+     location description to Bluetooth enabled user devices within its coverage
+     area.
+*/
+
+#define main LBeacon_main
+#include "../src/LBeacon.c"
+#undef main
+
+/* The number of decodes timed for each tag format */
+#define BENCH_NUMBER_DECODES 10000000
+
+/* Struct for a BLE payload of a tag format */
+typedef struct BenchTagPayload {
+
+    char *name;
+
+    uint16_t identifier;
+
+    /* The flags AD structure followed by the 0xFF field */
+    uint8_t payload[16];
+    size_t payload_length;
+
+} BenchTagPayload;
+
+/* The payloads of the tag formats, with the panic button pressed */
+static BenchTagPayload bench_tag_payloads[] = {
+    {"05C6", BIDAETECH_TAG_IDENTIFIER_05C6,
+     {0x02, 0x01, 0x06, 
+      0x07, 0xFF, 0x0D, 0x00, 0x05, 0xC6, 0x01, 0x2A}, 11},
+    {"05C7", BIDAETECH_TAG_IDENTIFIER_05C7,
+     {0x02, 0x01, 0x06, 
+      0x0B, 0xFF, 0x0D, 0x00, 0x05, 0xC7, 0xC1, 0x00, 0x00, 0x12, 0x34, 0x56},
+     15},
+    {"4153", BIDAETECH_TAG_IDENTIFIER_4153,
+     {0x02, 0x01, 0x06, 
+      0x07, 0xFF, 0x0D, 0x00, 0x41, 0x53, 0x01, 0x00}, 11}
+};
+
+
+/* A static function returning the time in nanoseconds from CLOCK_MONOTONIC */
+static double get_time_in_ns(){
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+
+int main(int argc, char **argv){
+
+    BenchTagPayload *tag;
+    BleAdvertisement advertisement;
+    TagDecoder *decoder;
+    TagData tag_data;
+    size_t i;
+    int j;
+    double start_time;
+    double elapsed_time;
+
+    for(i = 0; 
+        i < sizeof(bench_tag_payloads) / sizeof(bench_tag_payloads[0]); 
+        i++){
+
+        tag = &bench_tag_payloads[i];
+
+        parse_ble_advertisement(tag->payload, tag->payload_length, 
+                                &advertisement);
+
+        decoder = get_tag_decoder(tag->identifier);
+
+        memset(&tag_data, 0, sizeof(tag_data));
+
+        if(!decode_tag_data(tag->identifier, decoder, &advertisement, 
+                            &tag_data)){
+            fprintf(stderr, "Unable to decode tag format [%s]\n", tag->name);
+            return EXIT_FAILURE;
+        }
+
+        start_time = get_time_in_ns();
+
+        for(j = 0; j < BENCH_NUMBER_DECODES; j++){
+
+            decode_tag_data(tag->identifier, decoder, &advertisement, 
+                            &tag_data);
+
+            /* Keep the compiler from dropping the repeated decodes */
+            __asm__ volatile("" : : "g"(&tag_data) : "memory");
+        }
+
+        elapsed_time = get_time_in_ns() - start_time;
+
+        printf("decoder: format=[%s] ns_per_decode=[%.1f] button=[%d] "
+               "voltage=[%d] mac=[%012llX]\n",
+               tag->name, elapsed_time / BENCH_NUMBER_DECODES,
+               tag_data.is_button_pressed, tag_data.battery_voltage,
+               (unsigned long long) tag_data.mac_key);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -709,6 +709,18 @@ int get_clock_time()
 #endif
 }
 
+unsigned long long get_clock_time_in_us()
+{
+#ifdef _WIN32
+    return (unsigned long long) GetTickCount64() * 1000;
+#elif __unix__
+    struct timespec current_time;
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+    return (unsigned long long) current_time.tv_sec * 1000000 + 
+           current_time.tv_nsec / 1000;
+#endif
+}
+
 
 char *strtok_save(char *str, char *delim, char **saveptr)
 {
@@ -95,7 +95,14 @@
 
 #define BOT_GATEWAY_API_VERSION_12 "1.2"
 
-#define BOT_GATEWAY_API_VERSION_LATEST "1.3"
+#define BOT_GATEWAY_API_VERSION_13 "1.3"
+
+/* Version 1.4 adds the statistics of the RSSI values to each tracked device */
+#define BOT_GATEWAY_API_VERSION_14 "1.4"
+
+/* Version 1.5 appends the number and the MAC addresses of the BLE devices 
+   which left to the BLE devices, in the delta reporting mode of LBeacon */
+#define BOT_GATEWAY_API_VERSION_LATEST "1.5"
 
 /* Agent API protocol version for gateway to deploy commands to agent. */
 
@@ -912,6 +919,21 @@ int extern get_system_time();
 */
 int extern get_clock_time();
 
+/*
+  get_clock_time_in_us:
+
+     This helper function gets the monotonic time in microseconds.
+
+  Parameters:
+
+     None
+
+  Return value:
+
+     unsigned long long - uptime of MONOTONIC time in microseconds
+*/
+unsigned long long extern get_clock_time_in_us();
+
 /*
   display_time:
 
@@ -43,13 +43,478 @@
 #include "Mempool.h"
 
 
+/* A static function allocating a slab of the input length, aligned to the 
+   input alignment. */
+static void *mp_alloc_slab(size_t alignment, size_t length){
+
+    void *slab;
+
+#ifdef _WIN32
+    slab = _aligned_malloc(length, alignment);
+#else
+    if(0 != posix_memalign(&slab, alignment, length))
+        slab = NULL;
+#endif
+
+    return slab;
+}
+
+
+/* A static function freeing a slab allocated by mp_alloc_slab() */
+static void mp_free_slab(void *slab){
+
+#ifdef _WIN32
+    _aligned_free(slab);
+#else
+    free(slab);
+#endif
+}
+
+
+/* A static function returning the slab into which the input address falls.
+   The address is not checked to be in a slab of the memory pool. */
+static inline Memory_Pool_Slab *mp_get_slab(Memory_Pool *mp, void *mem){
+
+    return (Memory_Pool_Slab *) 
+        ((uintptr_t) mem & ~(uintptr_t) (mp->slab_alignment - 1));
+}
+
+
+/* A static function filling the input range of slots with the poison byte,
+   except the link to the next free slot at the start of each slot. */
+static void mp_poison_slots(Memory_Pool *mp, char *start, char *end){
+
+    char *ite;
+
+    for(ite = start; ite < end; ite += mp->size){
+        memset(ite + sizeof(void *), MEMORY_POOL_POISON_BYTE, 
+               mp->size - sizeof(void *));
+    }
+}
+
+
+/* A static function clearing a slot taken off the free list, according to the
+   policy of the memory pool. */
+static inline void mp_clear_allocated_slot(Memory_Pool *mp, void *mem){
+
+    /* The link to the next free slot is not part of the poison */
+    unsigned char *poison = (unsigned char *) mem + sizeof(void *);
+    size_t poison_size = mp->size - sizeof(void *);
+
+    switch(mp->zeroing){
+
+        case MEMORY_POOL_ZEROING_NONE:
+            break;
+
+        case MEMORY_POOL_ZEROING_POISON:
+
+            /* The bytes are all the poison byte if the first one is and each
+            byte equals the next one */
+            if(poison_size > 0 &&
+               (poison[0] != MEMORY_POOL_POISON_BYTE ||
+                memcmp(poison, poison + 1, poison_size - 1) != 0)){
+
+                __atomic_add_fetch(&mp->number_poison_errors, 1, 
+                                   __ATOMIC_RELAXED);
+            }
+
+            memset(mem, 0, mp->size);
+            break;
+
+        default:
+            memset(mem, 0, mp->size);
+            break;
+    }
+}
+
+
+/* A static function clearing a slot given back by the caller, according to 
+   the policy of the memory pool. */
+static inline void mp_clear_freed_slot(Memory_Pool *mp, void *mem){
+
+    if(mp->zeroing == MEMORY_POOL_ZEROING_POISON)
+        mp_poison_slots(mp, mem, (char *) mem + mp->size);
+}
+
+
+/* A static function taking mem_lock, and counting the time waited for it if
+   another thread holds it */
+static void mp_lock_mem_lock(Memory_Pool *mp){
+
+    struct timespec start_time;
+    struct timespec end_time;
+
+    if(pthread_mutex_trylock(&mp->mem_lock) == 0)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    pthread_mutex_lock(&mp->mem_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+    /* The counters are only written with mem_lock held */
+    __atomic_store_n(&mp->number_lock_contentions, 
+                     mp->number_lock_contentions + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&mp->lock_wait_time_in_ns, 
+                     mp->lock_wait_time_in_ns + 
+                     (end_time.tv_sec - start_time.tv_sec) * 1000000000ULL + 
+                     end_time.tv_nsec - start_time.tv_nsec, 
+                     __ATOMIC_RELAXED);
+}
+
+
+/* A static function taking mem_lock unless the memory pool is lock-free */
+static inline void mp_lock(Memory_Pool *mp){
+
+    if(!mp->is_lock_free)
+        mp_lock_mem_lock(mp);
+}
+
+
+/* A static function releasing mem_lock unless the memory pool is lock-free */
+static inline void mp_unlock(Memory_Pool *mp){
+
+    if(!mp->is_lock_free)
+        pthread_mutex_unlock(&mp->mem_lock);
+}
+
+
+/* A static function adding the input delta to a counter of the memory pool.
+   The counters are read without mem_lock, so that they are always written 
+   atomically, but only need an atomic read-modify-write if the memory pool is
+   lock-free. */
+static inline void mp_add_counter(Memory_Pool *mp, int *counter, int delta){
+
+    if(mp->is_lock_free)
+        __atomic_add_fetch(counter, delta, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(counter, *counter + delta, __ATOMIC_RELAXED);
+}
+
+
+/* A static function adding the input delta to a statistics counter of the 
+   memory pool, in the same way as mp_add_counter() */
+static inline void mp_add_stat(Memory_Pool *mp, unsigned long *counter, 
+                               unsigned long delta){
+
+    if(mp->is_lock_free)
+        __atomic_add_fetch(counter, delta, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(counter, *counter + delta, __ATOMIC_RELAXED);
+}
+
+
+/* A static function raising the peak number of used slots to the current 
+   number if it is higher */
+static inline void mp_update_peak_used_slots(Memory_Pool *mp){
+
+    int used_slots = __atomic_load_n(&mp->used_slots, __ATOMIC_RELAXED);
+    int peak_used_slots = 
+        __atomic_load_n(&mp->peak_used_slots, __ATOMIC_RELAXED);
+
+    while(used_slots > peak_used_slots && 
+          !__atomic_compare_exchange_n(&mp->peak_used_slots, 
+                                       &peak_used_slots, used_slots, 1,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+/* A static function pushing a slot onto the lock-free free list. The top of
+   the list packs a tag, incremented by every change of the top, in the upper
+   32 bits and the index of the top slot plus one in the lower 32 bits. A free
+   slot holds the index plus one of the next slot in its first 4 bytes. */
+static void mp_push_lock_free(Memory_Pool *mp, void *mem){
+
+    Memory_Pool_Slab *slab = mp_get_slab(mp, mem);
+    uint32_t index;
+    uint64_t top;
+    uint64_t new_top;
+
+    index = slab->index * mp->slots + 
+            ((char *) mem - slab->slots) / mp->size + 1;
+
+    top = __atomic_load_n(&mp->free_list_top, __ATOMIC_RELAXED);
+
+    do{
+        __atomic_store_n((uint32_t *) mem, (uint32_t) top, __ATOMIC_RELAXED);
+
+        new_top = (((top >> 32) + 1) << 32) | index;
+
+    }while(!__atomic_compare_exchange_n(&mp->free_list_top, &top, new_top,
+                                        1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+}
+
+
+/* A static function popping a slot off the lock-free free list, or returning
+   NULL if the list is empty. */
+static void *mp_pop_lock_free(Memory_Pool *mp){
+
+    uint32_t index;
+    uint64_t top;
+    uint64_t new_top;
+    char *mem;
+
+    top = __atomic_load_n(&mp->free_list_top, __ATOMIC_ACQUIRE);
+
+    do{
+        index = (uint32_t) top;
+
+        if(index == 0)
+            return NULL;
+
+        index--;
+
+        /* The slabs are never freed while the memory pool is in use, so that
+        the slot can be read even if another thread takes it meanwhile. The 
+        tag of the top then differs and the exchange fails. */
+        mem = (char *) mp->memory[index / mp->slots] + 
+              mp->slab_header_size + 
+              (size_t) (index % mp->slots) * mp->size;
+
+        new_top = (((top >> 32) + 1) << 32) | 
+                  __atomic_load_n((uint32_t *) mem, __ATOMIC_RELAXED);
+
+    }while(!__atomic_compare_exchange_n(&mp->free_list_top, &top, new_top,
+                                        1, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE));
+
+    return mem;
+}
+
+
+/* A static function putting a free slot back to the memory pool. It is 
+   called with mem_lock held unless the memory pool is lock-free. */
+static void mp_put_slot(Memory_Pool *mp, void *mem){
+
+    void *temp;
+    Memory_Pool_Slab *slab;
+
+    if(mp->is_lock_free){
+
+        mp_push_lock_free(mp, mem);
+
+    }else{
+
+        slab = mp_get_slab(mp, mem);
+        slab->used_slots--;
+
+        if(slab->is_draining && mp->head != NULL){
+
+            /* Append the slot, so that it is allocated last and its slab 
+            can become unused */
+            *(void **) mem = NULL;
+            *mp->tail = mem;
+            mp->tail = mem;
+
+        }else{
+
+            if(mp->head == NULL)
+                mp->tail = mem;
+
+            /* store first address */
+            temp = mp->head;
+            /* link new node */
+            mp->head = mem;
+            /* link to the list from new node */
+            *mp->head = temp;
+        }
+    }
+
+    mp_add_counter(mp, &mp->blocks, 1);
+}
+
+
+/* A static function taking a free slot from the memory pool, expanding the 
+   memory pool if it has no free slot, or returning NULL if it cannot expand.
+   It is called with mem_lock held unless the memory pool is lock-free. */
+static void *mp_take_slot(Memory_Pool *mp){
+
+    void *temp;
+    Memory_Pool_Slab *slab;
+
+    if(mp->is_lock_free){
+
+        while((temp = mp_pop_lock_free(mp)) == NULL){
+
+            /* Only one thread expands the memory pool. The others find the
+            new slots once they get the lock. */
+            mp_lock_mem_lock(mp);
+
+            if((uint32_t) __atomic_load_n(&mp->free_list_top, 
+                                          __ATOMIC_ACQUIRE) == 0 &&
+               mp_expand(mp) == MEMORY_POOL_ERROR){
+
+                pthread_mutex_unlock(&mp->mem_lock);
+                return NULL;
+            }
+
+            pthread_mutex_unlock(&mp->mem_lock);
+        }
+
+    }else{
+
+        if(mp->head == NULL){
+
+            /* If the next position which mp->head is pointing to is NULL,
+               expand the memory pool. */
+            if(mp_expand(mp) == MEMORY_POOL_ERROR)
+                return NULL;
+        }
+
+        /* store first address, i.e., address of the start of first 
+        element */
+        temp = mp->head;
+
+        /* link one past it */
+        mp->head = *mp->head;
+
+        if(mp->head == NULL)
+            mp->tail = NULL;
+
+        slab = mp_get_slab(mp, temp);
+
+        /* The slab is in use again, so that mp_shrink() waits for another 
+        idle period before releasing it */
+        if(slab->used_slots++ == 0)
+            slab->idle_since = 0;
+    }
+
+    mp_add_counter(mp, &mp->blocks, -1);
+
+    return temp;
+}
+
+
+/* A static function moving up to the input number of slots from the memory 
+   pool to the cache of a thread, expanding the memory pool if needed. */
+static void mp_refill_magazine(Memory_Pool_Magazine *magazine, 
+                               int number_slots){
+
+    Memory_Pool *mp = magazine->mp;
+    void *temp;
+
+    mp_lock(mp);
+
+    while(number_slots-- > 0 && (temp = mp_take_slot(mp)) != NULL){
+
+        magazine->slots[magazine->count++] = temp;
+
+        mp_add_counter(mp, &mp->used_slots, 1);
+    }
+
+    mp_add_stat(mp, &mp->number_allocs, magazine->number_allocs);
+    mp_add_stat(mp, &mp->number_frees, magazine->number_frees);
+    magazine->number_allocs = 0;
+    magazine->number_frees = 0;
+
+    mp_unlock(mp);
+
+    mp_update_peak_used_slots(mp);
+}
+
+
+/* A static function moving the input number of slots from the cache of a 
+   thread back to the memory pool */
+static void mp_flush_magazine(Memory_Pool_Magazine *magazine, 
+                              int number_slots){
+
+    Memory_Pool *mp = magazine->mp;
+
+    mp_lock(mp);
+
+    while(number_slots-- > 0){
+
+        mp_put_slot(mp, magazine->slots[--magazine->count]);
+
+        mp_add_counter(mp, &mp->used_slots, -1);
+    }
+
+    mp_add_stat(mp, &mp->number_allocs, magazine->number_allocs);
+    mp_add_stat(mp, &mp->number_frees, magazine->number_frees);
+    magazine->number_allocs = 0;
+    magazine->number_frees = 0;
+
+    mp_unlock(mp);
+}
+
+
+/* A static function returning the slots cached by an exiting thread to the
+   memory pool. It is the destructor of thread_cache_key. */
+static void mp_destroy_magazine(void *magazine){
+
+    mp_flush_magazine((Memory_Pool_Magazine *) magazine, 
+                      ((Memory_Pool_Magazine *) magazine)->count);
+
+    free(magazine);
+}
+
+
+/* A static function returning the cache of the calling thread for the memory
+   pool, or NULL if the cache cannot be created. */
+static Memory_Pool_Magazine *mp_get_magazine(Memory_Pool *mp){
+
+    Memory_Pool_Magazine *magazine;
+
+    magazine = pthread_getspecific(mp->thread_cache_key);
+
+    if(magazine == NULL){
+
+        magazine = malloc(sizeof(Memory_Pool_Magazine));
+
+        if(magazine == NULL)
+            return NULL;
+
+        magazine->mp = mp;
+        magazine->count = 0;
+        magazine->number_allocs = 0;
+        magazine->number_frees = 0;
+
+        if(pthread_setspecific(mp->thread_cache_key, magazine) != 0){
+            free(magazine);
+            return NULL;
+        }
+    }
+
+    return magazine;
+}
+
+#ifdef MEMORY_POOL_DEBUG
+
+/* A static function returning the bitmap of the allocated slots of the input
+   slab */
+static inline unsigned char *mp_get_allocated_bitmap(Memory_Pool_Slab *slab){
+
+    return (unsigned char *) (slab + 1);
+}
+
+
+/* A static function checking whether the input slab belongs to the memory 
+   pool. It is called with mem_lock held. */
+static int mp_is_slab_of_mempool(Memory_Pool *mp, Memory_Pool_Slab *slab){
+
+    int i;
+
+    for(i = 0; i < MAX_EXP_TIME; i++){
+
+        if(mp->memory[i] != NULL && mp->memory[i] == (void *) slab)
+            return MEMORY_POOL_SUCCESS;
+    }
+
+    return MEMORY_POOL_ERROR;
+}
+
+#endif
+
+
 size_t get_current_size_mempool(Memory_Pool *mp){
 
     size_t mem_size;
 
     pthread_mutex_lock(&mp->mem_lock);
 
-    mem_size = mp->alloc_time * mp->size * mp->slots;
+    mem_size = (size_t) mp->alloc_time * mp->size * mp->slots;
 
     pthread_mutex_unlock(&mp->mem_lock);
 
@@ -66,11 +531,40 @@ int mp_init(Memory_Pool *mp, size_t size, size_t slots){
 
     /* initialize and set parameters */
     mp->head = NULL;
+    mp->tail = NULL;
     mp->size = size;
     mp->slots = slots;
     mp->used_slots = 0;
     mp->alloc_time = 0;
     mp->blocks = 0;
+    mp->is_thread_cache_enabled = 0;
+    mp->is_lock_free = 0;
+    mp->free_list_top = 0;
+    mp->zeroing = MEMORY_POOL_ZEROING_ON_ALLOC;
+    mp->number_poison_errors = 0;
+    mp->peak_used_slots = 0;
+    mp->number_allocs = 0;
+    mp->number_frees = 0;
+    mp->number_alloc_failures = 0;
+    mp->number_slab_releases = 0;
+    mp->number_lock_contentions = 0;
+    mp->lock_wait_time_in_ns = 0;
+    memset(mp->memory, 0, sizeof(mp->memory));
+
+    /* The slots follow the header of the slab */
+    mp->slab_header_size = sizeof(Memory_Pool_Slab);
+#ifdef MEMORY_POOL_DEBUG
+    mp->slab_header_size += (slots + 7) / 8;
+#endif
+    mp->slab_header_size = 
+        (mp->slab_header_size + MEMORY_POOL_SLOT_ALIGNMENT - 1) & 
+        ~(size_t) (MEMORY_POOL_SLOT_ALIGNMENT - 1);
+
+    /* Align each slab to the power of two no less than its size, so that no 
+    two slabs share an aligned block */
+    mp->slab_alignment = MEMORY_POOL_SLOT_ALIGNMENT;
+    while(mp->slab_alignment < mp->slab_header_size + size * slots)
+        mp->slab_alignment <<= 1;
 
     pthread_mutex_init( &mp->mem_lock, 0);
 
@@ -89,8 +583,10 @@ int mp_init(Memory_Pool *mp, size_t size, size_t slots){
 int mp_expand(Memory_Pool *mp){
 
     int alloc_count;
+    int index;
+    Memory_Pool_Slab *slab;
+    size_t slab_size;
     char *end;
-    void *temp;
     char *ite;
 
     alloc_count = mp->alloc_time;
@@ -98,32 +594,39 @@ int mp_expand(Memory_Pool *mp){
     if(alloc_count == MAX_EXP_TIME)
         return MEMORY_POOL_ERROR;
 
-    mp->memory[alloc_count] = malloc(mp->size * mp->slots);
+    /* Reuse the first entry left by a released slab, if any */
+    for(index = 0; mp->memory[index] != NULL; index++);
+
+    slab_size = mp->slab_header_size + (size_t) mp->size * mp->slots;
+
+    slab = mp_alloc_slab(mp->slab_alignment, slab_size);
     
-    if(mp->memory[alloc_count] == NULL )
+    if(slab == NULL )
         return MEMORY_POOL_ERROR;
 
-    memset(mp->memory[alloc_count], 0, mp->size * mp->slots);
-
-    /* add every slot to the free list */
-    end = (char *)mp->memory[alloc_count] + mp->size * mp->slots;
+    /* Only the header needs to be zeroed. The slots are cleared when they 
+    are allocated, if the policy needs. */
+    memset(slab, 0, mp->slab_header_size);
 
-    for(ite = mp->memory[alloc_count]; ite < end; ite += mp->size){
+    slab->mp = mp;
+    slab->index = index;
+    slab->slots = (char *) slab + mp->slab_header_size;
 
-        /* store first address */
-        temp = mp->head;
+    /* The slots count as used until they are put in the free list */
+    slab->used_slots = mp->slots;
 
-        /* link the new node */
-        mp->head = (void *)ite;
+    mp->memory[index] = slab;
 
-        /* link to the list from new node */
-        *mp->head = temp;
+    /* add every slot to the free list */
+    end = slab->slots + (size_t) mp->size * mp->slots;
 
-        mp->blocks ++;
+    if(mp->zeroing == MEMORY_POOL_ZEROING_POISON)
+        mp_poison_slots(mp, slab->slots, end);
 
-    }
+    for(ite = slab->slots; ite < end; ite += mp->size)
+        mp_put_slot(mp, ite);
 
-    mp->alloc_time ++;
+    __atomic_store_n(&mp->alloc_time, alloc_count + 1, __ATOMIC_RELEASE);
 
 #ifdef debugging
     zlog_info(category_debug, 
@@ -135,19 +638,185 @@ int mp_expand(Memory_Pool *mp){
 }
 
 
+int mp_shrink(Memory_Pool *mp, int idle_time_in_sec){
+
+    struct timespec current_time;
+    Memory_Pool_Slab *slab;
+    Memory_Pool_Slab *kept_slab;
+    int is_released[MAX_EXP_TIME];
+    void *heads[MAX_EXP_TIME];
+    void **tails[MAX_EXP_TIME];
+    void *temp;
+    int number_slabs;
+    int number_kept;
+    int number_draining = 0;
+    int number_released = 0;
+    int i, j;
+
+    pthread_mutex_lock(&mp->mem_lock);
+
+    if(mp->is_lock_free){
+        pthread_mutex_unlock(&mp->mem_lock);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+    number_slabs = mp->alloc_time;
+
+    /* Keep the fewest slabs whose usage would stay at or below the threshold
+    if they held all the used slots */
+    for(number_kept = 1; 
+        number_kept < number_slabs && 
+        mp->used_slots > 
+        MEMORY_POOL_SHRINK_USAGE_THRESHOLD * number_kept * mp->slots;
+        number_kept++);
+
+    for(i = 0; i < MAX_EXP_TIME; i++){
+        if(mp->memory[i] != NULL){
+            __atomic_store_n(&((Memory_Pool_Slab *) mp->memory[i])->is_draining,
+                             1, __ATOMIC_RELAXED);
+        }
+    }
+
+    /* The slabs with the most used slots are kept, and the others drain */
+    for(j = 0; j < number_kept; j++){
+
+        kept_slab = NULL;
+
+        for(i = 0; i < MAX_EXP_TIME; i++){
+
+            slab = mp->memory[i];
+
+            if(slab != NULL && slab->is_draining && 
+               (kept_slab == NULL || slab->used_slots > kept_slab->used_slots))
+                kept_slab = slab;
+        }
+
+        __atomic_store_n(&kept_slab->is_draining, 0, __ATOMIC_RELAXED);
+    }
+
+    for(i = 0; i < MAX_EXP_TIME; i++){
+
+        is_released[i] = 0;
+        slab = mp->memory[i];
+
+        if(slab == NULL)
+            continue;
+
+        if(slab->used_slots != 0){
+
+            slab->idle_since = 0;
+
+        }else if(slab->idle_since == 0){
+
+            /* Start the idle period, so that a slab emptied by a short lull
+            is not released and allocated again */
+            slab->idle_since = current_time.tv_sec;
+
+        }else if(slab->is_draining && 
+                 current_time.tv_sec - slab->idle_since >= idle_time_in_sec){
+
+            is_released[i] = 1;
+            number_released++;
+        }
+
+        if(slab->is_draining && !is_released[i])
+            number_draining++;
+    }
+
+    /* Rebuild the free list without the slots of the released slabs, and 
+    with the slots of the draining slabs last */
+    if(number_released > 0 || number_draining > 0){
+
+        for(i = 0; i < MAX_EXP_TIME; i++){
+            heads[i] = NULL;
+            tails[i] = &heads[i];
+        }
+
+        while(mp->head != NULL){
+
+            temp = mp->head;
+            mp->head = *mp->head;
+
+            i = mp_get_slab(mp, temp)->index;
+
+            if(is_released[i])
+                continue;
+
+            *tails[i] = temp;
+            tails[i] = (void **) temp;
+        }
+
+        mp->tail = NULL;
+
+        for(j = 0; j < 2; j++){
+
+            for(i = MAX_EXP_TIME - 1; i >= 0; i--){
+
+                /* The draining slabs are linked first, behind the kept 
+                ones */
+                if(heads[i] == NULL || 
+                   ((Memory_Pool_Slab *) mp->memory[i])->is_draining == j)
+                    continue;
+
+                if(mp->tail == NULL)
+                    mp->tail = (void **) tails[i];
+
+                *tails[i] = mp->head;
+                mp->head = heads[i];
+            }
+        }
+    }
+
+    for(i = 0; i < MAX_EXP_TIME; i++){
+
+        if(!is_released[i])
+            continue;
+
+        mp_free_slab(mp->memory[i]);
+        mp->memory[i] = NULL;
+    }
+
+    mp_add_counter(mp, &mp->blocks, -number_released * mp->slots);
+    mp_add_stat(mp, &mp->number_slab_releases, number_released);
+    __atomic_store_n(&mp->alloc_time, number_slabs - number_released, 
+                     __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&mp->mem_lock);
+
+    return number_released;
+}
+
+
 void mp_destroy(Memory_Pool *mp){
 
     int i;
 
+    if(mp->is_thread_cache_enabled){
+
+        /* Only the cache of the calling thread is freed. The other threads 
+        must have stopped using the memory pool, and their caches are not 
+        returned to it once the key is deleted. */
+        free(pthread_getspecific(mp->thread_cache_key));
+        pthread_key_delete(mp->thread_cache_key);
+        mp->is_thread_cache_enabled = 0;
+    }
+
     pthread_mutex_lock( &mp->mem_lock);
 
     for(i = 0; i < MAX_EXP_TIME; i++){
 
-        mp->memory[i] = NULL;
-        free(mp->memory[i]);
+        if(mp->memory[i] != NULL){
+            mp_free_slab(mp->memory[i]);
+            mp->memory[i] = NULL;
+        }
     }
 
     mp->head = NULL;
+    mp->tail = NULL;
+    mp->free_list_top = 0;
+    mp->is_lock_free = 0;
     mp->size = 0;
     mp->slots = 0;
     mp->alloc_time = 0;
@@ -166,37 +835,135 @@ void mp_destroy(Memory_Pool *mp){
 }
 
 
-void *mp_alloc(Memory_Pool *mp){
+int mp_enable_thread_cache(Memory_Pool *mp){
+
+#ifndef MEMORY_POOL_DEBUG
+    if(pthread_key_create(&mp->thread_cache_key, mp_destroy_magazine) != 0)
+        return MEMORY_POOL_ERROR;
+
+    mp->is_thread_cache_enabled = 1;
+#endif
+
+    return MEMORY_POOL_SUCCESS;
+}
+
 
+int mp_set_zeroing(Memory_Pool *mp, MemoryPoolZeroing zeroing){
+
+    int i;
+
+    pthread_mutex_lock(&mp->mem_lock);
+
+    if(mp->used_slots != 0){
+        pthread_mutex_unlock(&mp->mem_lock);
+        return MEMORY_POOL_ERROR;
+    }
+
+    /* All the slots are free, so that they can be poisoned at once */
+    if(zeroing == MEMORY_POOL_ZEROING_POISON && 
+       mp->zeroing != MEMORY_POOL_ZEROING_POISON){
+
+        for(i = 0; i < MAX_EXP_TIME; i++){
+
+            if(mp->memory[i] == NULL)
+                continue;
+
+            mp_poison_slots(mp, 
+                            ((Memory_Pool_Slab *) mp->memory[i])->slots,
+                            ((Memory_Pool_Slab *) mp->memory[i])->slots +
+                            (size_t) mp->size * mp->slots);
+        }
+    }
+
+    mp->zeroing = zeroing;
+
+    pthread_mutex_unlock(&mp->mem_lock);
+
+    return MEMORY_POOL_SUCCESS;
+}
+
+
+int mp_enable_lock_free(Memory_Pool *mp){
+
+#ifndef MEMORY_POOL_DEBUG
     void *temp;
 
-    /*zlog_info(category_debug, "[mp_alloc] Attemp to mp_alloc, current " \
-                "blocks = [%d], current alloc times = [%d]", mp->blocks, 
-                mp->alloc_time);
-                */
     pthread_mutex_lock(&mp->mem_lock);
 
-    if(mp->head == NULL){
+    /* Move the free slots from the linked list to the lock-free one */
+    mp->is_lock_free = 1;
 
-        /* If the next position which mp->head is pointing to is NULL,
-           expand the memory pool. */
-        if(mp_expand(mp) == MEMORY_POOL_ERROR){
+    while(mp->head != NULL){
 
-            pthread_mutex_unlock(&mp->mem_lock);
+        temp = mp->head;
+        mp->head = *mp->head;
+
+        mp_push_lock_free(mp, temp);
+    }
+
+    mp->tail = NULL;
+
+    pthread_mutex_unlock(&mp->mem_lock);
+#endif
+
+    return MEMORY_POOL_SUCCESS;
+}
+
+
+void *mp_alloc(Memory_Pool *mp){
+
+    void *temp;
+    Memory_Pool_Magazine *magazine;
+#ifdef MEMORY_POOL_DEBUG
+    Memory_Pool_Slab *slab;
+    size_t index;
+#endif
+
+    if(mp->is_thread_cache_enabled && 
+       (magazine = mp_get_magazine(mp)) != NULL){
+
+        if(magazine->count == 0)
+            mp_refill_magazine(magazine, MEMORY_POOL_MAGAZINE_BATCH);
+
+        if(magazine->count == 0){
+            __atomic_add_fetch(&mp->number_alloc_failures, 1, 
+                               __ATOMIC_RELAXED);
             return NULL;
         }
+
+        temp = magazine->slots[--magazine->count];
+        magazine->number_allocs++;
+
+        mp_clear_allocated_slot(mp, temp);
+
+        return temp;
     }
 
-    /* store first address, i.e., address of the start of first element */
-    temp = mp->head;
+    /*zlog_info(category_debug, "[mp_alloc] Attemp to mp_alloc, current " \
+                "blocks = [%d], current alloc times = [%d]", mp->blocks, 
+                mp->alloc_time);
+                */
+    mp_lock(mp);
+
+    temp = mp_take_slot(mp);
+
+    if(temp == NULL){
+
+        mp_unlock(mp);
 
-    /* link one past it */
-    mp->head = *mp->head;
+        __atomic_add_fetch(&mp->number_alloc_failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
     
     // count the slots usage
-    mp->used_slots = mp->used_slots + 1;
+    mp_add_counter(mp, &mp->used_slots, 1);
+    mp_add_stat(mp, &mp->number_allocs, 1);
 
-    mp->blocks --;
+#ifdef MEMORY_POOL_DEBUG
+    slab = mp_get_slab(mp, temp);
+    index = ((char *) temp - slab->slots) / mp->size;
+    mp_get_allocated_bitmap(slab)[index / 8] |= 1 << (index % 8);
+#endif
 
 #ifdef debugging
     zlog_info(category_debug, 
@@ -204,9 +971,11 @@ void *mp_alloc(Memory_Pool *mp){
               mp, mp->blocks);
 #endif
 
-    memset(temp, 0, mp->size);
+    mp_unlock(mp);
 
-    pthread_mutex_unlock( &mp->mem_lock);
+    mp_update_peak_used_slots(mp);
+
+    mp_clear_allocated_slot(mp, temp);
 
     /* return the first address */
     return temp;
@@ -216,40 +985,85 @@ void *mp_alloc(Memory_Pool *mp){
 
 int mp_free(Memory_Pool *mp, void *mem){
 
-    int closest = -1;
-    int i;
-    int differenceinbyte;
-    void *temp;
+    Memory_Pool_Slab *slab;
+    size_t offset;
+    Memory_Pool_Magazine *magazine;
+#ifdef MEMORY_POOL_DEBUG
+    unsigned char *allocated;
+    size_t index;
+#endif
 
-    pthread_mutex_lock(&mp->mem_lock);
+    if(mem == NULL)
+        return MEMORY_POOL_ERROR;
 
-    /* Check all the expanded memory space, to find the closest and
-    most relevant mem_head for the current freeing memory. */
-    for(i = 0; i < mp->alloc_time; i++){
+    /* The slab of the slot is found from the address of the slot, no matter
+    how many times the memory pool expanded. */
+    slab = mp_get_slab(mp, mem);
 
-        /* Calculate the offset from mem to mp->memory */
-        differenceinbyte = (int)mem - (int)mp->memory[i];
-        /* Only consider the positive offset */
-        if((differenceinbyte > 0) && ((differenceinbyte < closest) ||
-           (closest == -1)))
-            closest = differenceinbyte;
+#ifdef MEMORY_POOL_DEBUG
+    pthread_mutex_lock(&mp->mem_lock);
+
+    /* Check the slab before reading its header, in case mem is not from any
+    memory pool */
+    if(mp_is_slab_of_mempool(mp, slab) == MEMORY_POOL_ERROR){
+        pthread_mutex_unlock(&mp->mem_lock);
+        return MEMORY_POOL_ERROR;
     }
-    /* check if mem is correct, i.e. is pointing to the struct of a slot */
-    if((closest % mp->size) != 0){
+
+    pthread_mutex_unlock(&mp->mem_lock);
+#endif
+
+    if(slab->mp != mp)
+        return MEMORY_POOL_ERROR;
+
+    /* check if mem is correct, i.e. is pointing to the struct of a slot. An 
+    address in the header of the slab wraps around to a large offset. */
+    offset = (uintptr_t) mem - (uintptr_t) slab->slots;
+
+    if(offset >= (size_t) mp->size * mp->slots || (offset % mp->size) != 0)
+        return MEMORY_POOL_ERROR;
+
+#ifdef MEMORY_POOL_DEBUG
+    pthread_mutex_lock(&mp->mem_lock);
+
+    allocated = mp_get_allocated_bitmap(slab);
+    index = offset / mp->size;
+
+    if((allocated[index / 8] & (1 << (index % 8))) == 0){
+
+        /* The slot is already free */
         pthread_mutex_unlock(&mp->mem_lock);
         return MEMORY_POOL_ERROR;
     }
 
-    memset(mem, 0, mp->size);
+    allocated[index / 8] &= ~(1 << (index % 8));
 
-    /* store first address */
-    temp = mp->head;
-    /* link new node */
-    mp->head = mem;
-    /* link to the list from new node */
-    *mp->head = temp;
+    pthread_mutex_unlock(&mp->mem_lock);
+#endif
+
+    /* The slot is no longer used by the caller, so that it is cleared before
+    taking the lock. */
+    mp_clear_freed_slot(mp, mem);
+
+    /* The slots of a draining slab bypass the cache of the thread, so that
+    they are not allocated again before the slots of the kept slabs */
+    if(mp->is_thread_cache_enabled && 
+       !__atomic_load_n(&slab->is_draining, __ATOMIC_RELAXED) &&
+       (magazine = mp_get_magazine(mp)) != NULL){
 
-    mp->blocks ++;
+        /* Keep half of the cache for the next frees */
+        if(magazine->count == MEMORY_POOL_MAGAZINE_SIZE)
+            mp_flush_magazine(magazine, MEMORY_POOL_MAGAZINE_BATCH);
+
+        magazine->slots[magazine->count++] = mem;
+        magazine->number_frees++;
+
+        return MEMORY_POOL_SUCCESS;
+    }
+
+    mp_lock(mp);
+
+    mp_put_slot(mp, mem);
 
 #ifdef debugging
     zlog_info(category_debug, 
@@ -257,17 +1071,44 @@ int mp_free(Memory_Pool *mp, void *mem){
               mp, mp->blocks);
 #endif
     // count the slots usage
-    mp->used_slots = mp->used_slots - 1;
+    mp_add_counter(mp, &mp->used_slots, -1);
+    mp_add_stat(mp, &mp->number_frees, 1);
     
-    pthread_mutex_unlock(&mp->mem_lock);
+    mp_unlock(mp);
 
     return MEMORY_POOL_SUCCESS;
 }
 
+void mp_get_stats(Memory_Pool *mp, Memory_Pool_Stats *stats){
+
+    stats->size = mp->size;
+    stats->slots_per_expansion = mp->slots;
+    stats->number_slabs = __atomic_load_n(&mp->alloc_time, __ATOMIC_ACQUIRE);
+    stats->used_slots = __atomic_load_n(&mp->used_slots, __ATOMIC_RELAXED);
+    stats->peak_used_slots = 
+        __atomic_load_n(&mp->peak_used_slots, __ATOMIC_RELAXED);
+    stats->free_slots = __atomic_load_n(&mp->blocks, __ATOMIC_RELAXED);
+    stats->number_allocs = 
+        __atomic_load_n(&mp->number_allocs, __ATOMIC_RELAXED);
+    stats->number_frees = __atomic_load_n(&mp->number_frees, __ATOMIC_RELAXED);
+    stats->number_alloc_failures = 
+        __atomic_load_n(&mp->number_alloc_failures, __ATOMIC_RELAXED);
+    stats->number_slab_releases = 
+        __atomic_load_n(&mp->number_slab_releases, __ATOMIC_RELAXED);
+    stats->number_lock_contentions = 
+        __atomic_load_n(&mp->number_lock_contentions, __ATOMIC_RELAXED);
+    stats->lock_wait_time_in_ns = 
+        __atomic_load_n(&mp->lock_wait_time_in_ns, __ATOMIC_RELAXED);
+    stats->number_poison_errors = 
+        __atomic_load_n(&mp->number_poison_errors, __ATOMIC_RELAXED);
+}
+
 float mp_slots_usage_percentage(Memory_Pool *mp){
     float usage_percentage = 0;
     
-    usage_percentage = (mp->used_slots*1.0) / (mp->alloc_time * mp->slots);
+    usage_percentage = 
+        (__atomic_load_n(&mp->used_slots, __ATOMIC_RELAXED) * 1.0) / 
+        (__atomic_load_n(&mp->alloc_time, __ATOMIC_ACQUIRE) * mp->slots);
 
     return usage_percentage;
 }
@@ -44,8 +44,10 @@
 #define MEMPOOL_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -54,20 +56,106 @@
 /* When debugging is needed */
 //#define debugging
 
+/* When the frees of slots are to be checked for double frees and pointers not
+   allocated from the memory pool */
+//#define MEMORY_POOL_DEBUG
+
 #define MEMORY_POOL_SUCCESS 1
 #define MEMORY_POOL_ERROR 0
 #define MEMORY_POOL_MINIMUM_SIZE sizeof(void *)
 #define MAX_EXP_TIME 10
 
+/* The alignment in bytes of the first slot of each slab */
+#define MEMORY_POOL_SLOT_ALIGNMENT 16
+
+/* The number of free slots a thread caches for a memory pool */
+#define MEMORY_POOL_MAGAZINE_SIZE 32
+
+/* The number of slots moved between the cache of a thread and the memory 
+   pool at a time */
+#define MEMORY_POOL_MAGAZINE_BATCH (MEMORY_POOL_MAGAZINE_SIZE / 2)
+
+/* The usage of the slabs left after a slab is released by mp_shrink(), above
+   which the slab is kept so that the memory pool does not expand again right
+   away */
+#define MEMORY_POOL_SHRINK_USAGE_THRESHOLD 0.5
+
+/* The byte the slots are filled with when freed under the poison policy */
+#define MEMORY_POOL_POISON_BYTE 0xA5
+
+/* The policies of clearing the slots of a memory pool */
+typedef enum MemoryPoolZeroing {
+
+    /* The slots are returned as they were freed, or with undefined content
+       if they were never allocated */
+    MEMORY_POOL_ZEROING_NONE = 0,
+    /* The slots are zeroed when allocated */
+    MEMORY_POOL_ZEROING_ON_ALLOC = 1,
+    /* The slots are filled with MEMORY_POOL_POISON_BYTE when freed, checked 
+       for writes after free when allocated, and then zeroed */
+    MEMORY_POOL_ZEROING_POISON = 2
+
+} MemoryPoolZeroing;
+
+/* The header at the start of each slab of slots. Each slab is aligned to the
+   power of two no less than its size, so that the slab of a slot is found by
+   masking the address of the slot. In the debug mode, the header is followed
+   by a bitmap with one bit per slot, set while the slot is allocated. */
+typedef struct Memory_Pool_Slab {
+
+    /* The memory pool owning the slab */
+    struct Memory_Pool *mp;
+
+    /* The index of the slab in the memory array of the memory pool */
+    int index;
+
+    /* The address of the first slot of the slab */
+    char *slots;
+
+    /* The number of slots of the slab not in the free list, i.e. allocated or
+       cached by the threads. It is not tracked if the memory pool is 
+       lock-free. */
+    int used_slots;
+
+    /* The time in seconds since which mp_shrink() has found the slab unused,
+       or 0 if the slab is used since the last call */
+    time_t idle_since;
+
+    /* Whether mp_shrink() expects the slab to become unused, in which case
+       its freed slots are appended to the free list instead of prepended */
+    int is_draining;
+
+} Memory_Pool_Slab;
+
 /* The structure of the memory pool */
-typedef struct {
+typedef struct Memory_Pool {
     /* The head of the unused slots */
     void **head;
 
-    /* An array stores the head of each malloced memory */
+    /* The last of the unused slots, or NULL if there is none */
+    void **tail;
+
+    /* Whether the unused slots are in a lock-free stack instead of the list 
+       under mem_lock */
+    int is_lock_free;
+
+    /* The top of the lock-free stack of the unused slots. The lower 32 bits
+       are the index of the top slot among all the slots of the memory pool 
+       plus one, or 0 if the stack is empty. The upper 32 bits are a tag
+       changed by every push and pop, against the ABA problem. */
+    uint64_t free_list_top;
+
+    /* An array stores the head of each malloced memory, which is the header
+       of a slab, or NULL if the slab is not allocated or is released */
     void *memory[MAX_EXP_TIME];
 
-    /* Counting current malloc times */
+    /* The alignment in bytes of the slabs, a power of two */
+    size_t slab_alignment;
+
+    /* The size in bytes of the header before the first slot of a slab */
+    size_t slab_header_size;
+
+    /* The number of slabs currently allocated */
     int alloc_time;
 
     /* A per list lock */
@@ -79,13 +167,98 @@ typedef struct {
     /* The number of slots is made each time the mempool expand */
     int slots;
 
+    /* The policy of clearing the slots */
+    MemoryPoolZeroing zeroing;
+
+    /* The number of slots found written after they were freed, under the 
+       poison policy, updated atomically */
+    int number_poison_errors;
+
+    /* The statistics of the memory pool, updated atomically. The allocations
+       and frees served by the cache of a thread are counted when the cache 
+       is refilled or flushed. */
+    int peak_used_slots;
+    unsigned long number_allocs;
+    unsigned long number_frees;
+    unsigned long number_alloc_failures;
+    unsigned long number_slab_releases;
+
+    /* The number of times mem_lock is held by another thread when taken, and
+       the total time waited for it in nanoseconds */
+    unsigned long number_lock_contentions;
+    unsigned long long lock_wait_time_in_ns;
+
+    /* The number of unused slots, updated atomically */
     int blocks;
     
-    /* counter for calculating the slots usage */
+    /* counter for calculating the slots usage, updated atomically. The slots
+       cached by the threads count as used. */
     int used_slots;
 
+    /* Whether each thread caches free slots of the memory pool */
+    int is_thread_cache_enabled;
+
+    /* The key of the cache of free slots of each thread */
+    pthread_key_t thread_cache_key;
+
 } Memory_Pool;
 
+/* The cache of free slots of a thread for a memory pool. The thread allocates
+   and frees slots in its cache without taking mem_lock, and refills or 
+   flushes the cache in batches. */
+typedef struct Memory_Pool_Magazine {
+
+    /* The memory pool of the slots */
+    Memory_Pool *mp;
+
+    /* The number of slots in the cache */
+    int count;
+
+    void *slots[MEMORY_POOL_MAGAZINE_SIZE];
+
+    /* The numbers of allocations and frees served by the cache since it was
+       last refilled or flushed */
+    unsigned long number_allocs;
+    unsigned long number_frees;
+
+} Memory_Pool_Magazine;
+
+/* Struct for the statistics of a memory pool */
+typedef struct Memory_Pool_Stats {
+
+    /* The size of each slot in bytes */
+    size_t size;
+
+    /* The number of slots added by each expansion */
+    int slots_per_expansion;
+
+    /* The number of slabs currently allocated, up to MAX_EXP_TIME */
+    int number_slabs;
+
+    /* The current, peak and unused numbers of slots. The slots cached by the
+       threads count as used. */
+    int used_slots;
+    int peak_used_slots;
+    int free_slots;
+
+    /* The numbers of allocations, frees and failed allocations */
+    unsigned long number_allocs;
+    unsigned long number_frees;
+    unsigned long number_alloc_failures;
+
+    /* The number of slabs released by mp_shrink() */
+    unsigned long number_slab_releases;
+
+    /* The number of times mem_lock is held by another thread when taken, and
+       the total time waited for it in nanoseconds */
+    unsigned long number_lock_contentions;
+    unsigned long long lock_wait_time_in_ns;
+
+    /* The number of slots written after they were freed */
+    int number_poison_errors;
+
+} Memory_Pool_Stats;
+
 
 /*
   get_current_size_mempool:
@@ -139,6 +312,92 @@ int mp_init(Memory_Pool *mp, size_t size, size_t slots);
 int mp_expand(Memory_Pool *mp);
 
 
+/*
+  mp_shrink:
+
+     This function returns to the OS the slabs of the memory pool which have
+     been unused for at least the input time, as long as the usage of the 
+     remaining slabs stays at or below MEMORY_POOL_SHRINK_USAGE_THRESHOLD. The
+     last slab is never released. The fewest slabs which can hold the used
+     slots within the threshold are kept, and the others drain: their free 
+     slots are moved to the end of the free list, so that they are allocated
+     last. The slots cached by the threads keep their slabs in use. It is 
+     meant to be called periodically, and does nothing if the memory pool is
+     lock-free, since a slot being popped from the lock-free stack may still
+     be read after it is taken.
+
+  Parameters:
+
+     mp - pointer to a specific memory pool
+     idle_time_in_sec - the time in seconds a slab has to stay unused, as 
+                        seen by the calls to this function, to be released
+
+  Return value:
+
+     int - the number of slabs released
+ */
+int mp_shrink(Memory_Pool *mp, int idle_time_in_sec);
+
+
+/*
+  mp_set_zeroing:
+
+     This function sets the policy of clearing the slots of the memory pool.
+     The slots are zeroed when allocated unless the caller sets another 
+     policy. It must be called before any slot is allocated.
+
+  Parameters:
+
+     mp - pointer to a specific memory pool
+     zeroing - the policy of clearing the slots
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int mp_set_zeroing(Memory_Pool *mp, MemoryPoolZeroing zeroing);
+
+
+/*
+  mp_enable_thread_cache:
+
+     This function makes each thread using the memory pool cache up to 
+     MEMORY_POOL_MAGAZINE_SIZE free slots, so that most allocations and frees
+     take no lock. The slots cached by a thread return to the memory pool when
+     the thread exits. It must be called before the memory pool is shared by
+     threads. In the debug mode, the threads do not cache slots, so that every
+     free is checked.
+
+  Parameters:
+
+     mp - pointer to a specific memory pool
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int mp_enable_thread_cache(Memory_Pool *mp);
+
+
+/*
+  mp_enable_lock_free:
+
+     This function keeps the unused slots of the memory pool in a lock-free
+     stack, so that allocations and frees take no lock except when the memory
+     pool expands. It must be called before the memory pool is shared by 
+     threads. In the debug mode, the memory pool keeps using mem_lock.
+
+  Parameters:
+
+     mp - pointer to a specific memory pool
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int mp_enable_lock_free(Memory_Pool *mp);
+
+
 /*
   mp_destroy:
 
@@ -177,7 +436,12 @@ void *mp_alloc(Memory_Pool *mp);
 /*
   mp_free:
 
-     This function releases a slot back to the memory pool.
+     This function releases a slot back to the memory pool. The slab of the
+     slot is found from the address of the slot in constant time. Slots of 
+     other memory pools are rejected, but passing a pointer not allocated 
+     from any memory pool is undefined behaviour, as it is for free(), unless
+     MEMORY_POOL_DEBUG is defined. In the debug mode, double frees and 
+     pointers not allocated from the memory pool are rejected.
 
   Parameters:
 
@@ -190,6 +454,23 @@ void *mp_alloc(Memory_Pool *mp);
  */
 int mp_free(Memory_Pool *mp, void *mem);
 
+/*
+  mp_get_stats:
+
+     This function gets the statistics of the memory pool. Each counter is 
+     read atomically, without taking mem_lock.
+
+  Parameters:
+
+     mp - the pointer to the specific memory pool
+     stats - pointer to the struct to receive the statistics
+
+  Return value:
+
+     None
+*/
+void mp_get_stats(Memory_Pool *mp, Memory_Pool_Stats *stats);
+
 /*
   mp_slots_usage_percentage:
 
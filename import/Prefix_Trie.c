@@ -0,0 +1,159 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+  Project Name:
+
+     BeDIS
+
+  File Name:
+
+     Prefix_Trie.c
+
+  File Description:
+
+     This file contains the program of a trie of hex-digit prefixes, used to
+     find in a single pass the first of many prefixes which matches the input
+     data.
+
+  Version:
+
+     2.0, 20201016
+
+  Abstract:
+
+     BeDIS uses LBeacons to deliver 3D coordinates and textual descriptions of
+     their locations to users' devices. Basically, a LBeacon is an inexpensive,
+     Bluetooth Smart Ready device. The 3D coordinates and location description
+     of every LBeacon are retrieved from BeDIS (Building/environment Data and
+     Information System) and stored locally during deployment and maintenance
+     times. Once initialized, each LBeacon broadcasts its coordinates and
+     location description to Bluetooth enabled user devices within its coverage
+     area.
+*/
+
+#include "Prefix_Trie.h"
+
+
+/* A static function returning the hex digit at the specified index of the
+   data. */
+static inline uint8_t get_hex_digit(uint8_t *data, size_t index){
+
+    if(index % 2 == 0)
+        return data[index / 2] >> 4;
+
+    return data[index / 2] & 0x0F;
+}
+
+
+int pt_init(Prefix_Trie *trie){
+
+    trie->nodes = malloc(sizeof(Prefix_Trie_Node) * PREFIX_TRIE_INITIAL_NODES);
+
+    if(trie->nodes == NULL)
+        return PREFIX_TRIE_ERROR;
+
+    trie->capacity = PREFIX_TRIE_INITIAL_NODES;
+    trie->number_nodes = 1;
+
+    memset(&trie->nodes[0], 0, sizeof(Prefix_Trie_Node));
+
+    return PREFIX_TRIE_SUCCESS;
+}
+
+
+void pt_destroy(Prefix_Trie *trie){
+
+    free(trie->nodes);
+    trie->nodes = NULL;
+    trie->number_nodes = 0;
+    trie->capacity = 0;
+}
+
+
+int pt_insert(Prefix_Trie *trie,
+              uint8_t *prefix,
+              size_t number_digits,
+              void *value,
+              int priority){
+
+    Prefix_Trie_Node *new_nodes;
+    unsigned int new_capacity;
+    unsigned int current = 0;
+    unsigned int child;
+    uint8_t digit;
+    size_t i;
+
+    for(i = 0 ; i < number_digits ; i++){
+
+        digit = get_hex_digit(prefix, i);
+        child = trie->nodes[current].children[digit];
+
+        if(child == 0){
+
+            if(trie->number_nodes >= PREFIX_TRIE_MAX_NODES)
+                return PREFIX_TRIE_ERROR;
+
+            if(trie->number_nodes == trie->capacity){
+
+                new_capacity = trie->capacity * 2;
+                if(new_capacity > PREFIX_TRIE_MAX_NODES)
+                    new_capacity = PREFIX_TRIE_MAX_NODES;
+
+                new_nodes = realloc(trie->nodes,
+                                    sizeof(Prefix_Trie_Node) * new_capacity);
+                if(new_nodes == NULL)
+                    return PREFIX_TRIE_ERROR;
+
+                trie->nodes = new_nodes;
+                trie->capacity = new_capacity;
+            }
+
+            child = trie->number_nodes;
+            trie->number_nodes++;
+
+            memset(&trie->nodes[child], 0, sizeof(Prefix_Trie_Node));
+            trie->nodes[current].children[digit] = child;
+        }
+
+        current = child;
+    }
+
+    if(trie->nodes[current].value == NULL ||
+       priority < trie->nodes[current].priority){
+
+        trie->nodes[current].value = value;
+        trie->nodes[current].priority = priority;
+    }
+
+    return PREFIX_TRIE_SUCCESS;
+}
+
+
+void *pt_match(Prefix_Trie *trie, uint8_t *data, size_t number_digits){
+
+    Prefix_Trie_Node *node = &trie->nodes[0];
+    void *value = node->value;
+    int priority = node->priority;
+    unsigned int child;
+    size_t i;
+
+    for(i = 0 ; i < number_digits ; i++){
+
+        child = node->children[get_hex_digit(data, i)];
+
+        if(child == 0)
+            break;
+
+        node = &trie->nodes[child];
+
+        if(node->value != NULL &&
+           (value == NULL || node->priority < priority)){
+
+            value = node->value;
+            priority = node->priority;
+        }
+    }
+
+    return value;
+}
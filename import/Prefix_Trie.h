@@ -0,0 +1,166 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+  Project Name:
+
+     BeDIS
+
+  File Name:
+
+     Prefix_Trie.h
+
+  File Description:
+
+     This file contains the declarations and definition of variables used in
+     the Prefix_Trie.c file.
+
+  Version:
+
+      2.0, 20201016
+
+  Abstract:
+
+     BeDIS uses LBeacons to deliver 3D coordinates and textual descriptions of
+     their locations to users' devices. Basically, a LBeacon is an inexpensive,
+     Bluetooth Smart Ready device. The 3D coordinates and location description
+     of every LBeacon are retrieved from BeDIS (Building/environment Data and
+     Information System) and stored locally during deployment and maintenance
+     times. Once initialized, each LBeacon broadcasts its coordinates and
+     location description to Bluetooth enabled user devices within its coverage
+     area.
+ */
+
+#ifndef PREFIX_TRIE_H
+#define PREFIX_TRIE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PREFIX_TRIE_SUCCESS 1
+#define PREFIX_TRIE_ERROR 0
+
+/* The number of children of a node. The trie branches on hex digits, so that
+   prefixes ending in the middle of a byte are supported. */
+#define PREFIX_TRIE_FANOUT 16
+
+/* The initial number of nodes allocated for a trie */
+#define PREFIX_TRIE_INITIAL_NODES 64
+
+/* The maximum number of nodes in a trie, limited by the width of the child
+   indexes */
+#define PREFIX_TRIE_MAX_NODES 65535
+
+/* The structure of a node in the trie */
+typedef struct {
+
+    /* The indexes of the children in the node array. 0 means no child, since
+       the root is never a child. */
+    uint16_t children[PREFIX_TRIE_FANOUT];
+
+    /* The priority of the value. A lower number takes precedence. */
+    int priority;
+
+    /* The value attached to the prefix ending at this node, or NULL */
+    void *value;
+
+} Prefix_Trie_Node;
+
+/* The structure of the prefix trie. The nodes are kept in a single array to
+   improve the cache locality of lookups. The trie is built once and then
+   only read, so that lookups from several threads need no lock. */
+typedef struct {
+
+    /* The array of all the nodes. The root is the first node. */
+    Prefix_Trie_Node *nodes;
+
+    /* The number of nodes in use */
+    unsigned int number_nodes;
+
+    /* The number of nodes allocated */
+    unsigned int capacity;
+
+} Prefix_Trie;
+
+
+/*
+  pt_init:
+
+     This function allocates the nodes of the trie and initializes the root.
+
+  Parameters:
+
+     trie - pointer to a specific trie
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int pt_init(Prefix_Trie *trie);
+
+
+/*
+  pt_destroy:
+
+     This function frees all the nodes of the trie. The values attached to
+     the nodes are not freed.
+
+  Parameters:
+
+     trie - pointer to the specific trie to be destroyed
+
+  Return value:
+
+     None
+ */
+void pt_destroy(Prefix_Trie *trie);
+
+
+/*
+  pt_insert:
+
+     This function attaches a value to a prefix in the trie. If a value is
+     already attached to the same prefix, the value with the lower priority
+     number is kept.
+
+  Parameters:
+
+     trie - pointer to the specific trie
+     prefix - the bytes of the prefix. The first hex digit is the high
+              nibble of the first byte.
+     number_digits - the number of hex digits in the prefix
+     value - the value to be attached to the prefix
+     priority - the priority of the value. A lower number takes precedence.
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int pt_insert(Prefix_Trie *trie,
+              uint8_t *prefix,
+              size_t number_digits,
+              void *value,
+              int priority);
+
+
+/*
+  pt_match:
+
+     This function walks the trie once along the input data and returns the
+     value with the lowest priority number among all the prefixes of the
+     data.
+
+  Parameters:
+
+     trie - pointer to the specific trie
+     data - the bytes to be matched
+     number_digits - the number of hex digits of the data to be matched
+
+  Return value:
+
+     void - the matched value or NULL if no prefix matches
+ */
+void *pt_match(Prefix_Trie *trie, uint8_t *data, size_t number_digits);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+  Project Name:
+
+     BeDIS
+
+  File Name:
+
+     SPSC_Queue.c
+
+  File Description:
+
+     This file contains the program of a lock-free ring of preallocated slots
+     for passing structs of identical size from one producer thread to one
+     consumer thread.
+
+  Version:
+
+     2.0, 20201016
+
+  Abstract:
+
+     BeDIS uses LBeacons to deliver 3D coordinates and textual descriptions of
+     their locations to users' devices. Basically, a LBeacon is an inexpensive,
+     Bluetooth Smart Ready device. The 3D coordinates and location description
+     of every LBeacon are retrieved from BeDIS (Building/environment Data and
+     Information System) and stored locally during deployment and maintenance
+     times. Once initialized, each LBeacon broadcasts its coordinates and
+     location description to Bluetooth enabled user devices within its coverage
+     area.
+*/
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "SPSC_Queue.h"
+
+
+int spsc_init(SPSC_Queue *queue, size_t size, size_t slots){
+
+    unsigned int capacity = 1;
+
+    /* Round the number of slots up to a power of two, so that the index of
+       a slot is the counter masked by capacity - 1. */
+    while(capacity < slots)
+        capacity <<= 1;
+
+    queue->size = size;
+    queue->capacity = capacity;
+    queue->tail = 0;
+    queue->head = 0;
+    queue->high_watermark = 0;
+    queue->overflow_count = 0;
+    queue->is_consumer_waiting = 0;
+
+    queue->slots = malloc(size * capacity);
+
+    if(queue->slots == NULL)
+        return SPSC_QUEUE_ERROR;
+
+    queue->event_fd = eventfd(0, EFD_NONBLOCK);
+
+    if(queue->event_fd < 0){
+
+        free(queue->slots);
+        queue->slots = NULL;
+        return SPSC_QUEUE_ERROR;
+    }
+
+    return SPSC_QUEUE_SUCCESS;
+}
+
+
+void spsc_destroy(SPSC_Queue *queue){
+
+    free(queue->slots);
+    queue->slots = NULL;
+
+    if(queue->event_fd >= 0)
+        close(queue->event_fd);
+
+    queue->event_fd = -1;
+    queue->capacity = 0;
+}
+
+
+void *spsc_reserve(SPSC_Queue *queue){
+
+    unsigned int tail;
+    unsigned int head;
+
+    tail = queue->tail;
+    head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+    if(tail - head >= queue->capacity){
+
+        __atomic_add_fetch(&queue->overflow_count, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    return queue->slots + (tail & (queue->capacity - 1)) * queue->size;
+}
+
+
+void spsc_commit(SPSC_Queue *queue){
+
+    unsigned int tail;
+    unsigned int length;
+    uint64_t event = 1;
+
+    tail = queue->tail + 1;
+
+    /* Publish the filled slot to the consumer */
+    __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+
+    length = tail - __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+
+    if(length > queue->high_watermark)
+        __atomic_store_n(&queue->high_watermark, length, __ATOMIC_RELAXED);
+
+    /* The full fence pairs with the one in spsc_wait(): either the consumer
+       sees the new tail before it sleeps, or we see it is waiting here. Only
+       in the latter case a system call is needed. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&queue->is_consumer_waiting, __ATOMIC_RELAXED))
+        write(queue->event_fd, &event, sizeof(event));
+}
+
+
+void *spsc_peek(SPSC_Queue *queue){
+
+    unsigned int head;
+
+    head = queue->head;
+
+    if(head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    return queue->slots + (head & (queue->capacity - 1)) * queue->size;
+}
+
+
+void spsc_release(SPSC_Queue *queue){
+
+    __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+}
+
+
+bool spsc_wait(SPSC_Queue *queue, int timeout_in_ms){
+
+    struct pollfd event_poll;
+    uint64_t event;
+
+    if(queue->head != __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE))
+        return true;
+
+    __atomic_store_n(&queue->is_consumer_waiting, 1, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    /* Check again after announcing the wait, in case the producer committed
+       a slot before it could see the flag. */
+    if(queue->head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)){
+
+        event_poll.fd = queue->event_fd;
+        event_poll.events = POLLIN;
+        event_poll.revents = 0;
+
+        if(0 < poll(&event_poll, 1, timeout_in_ms)){
+
+            /* Reset the eventfd counter */
+            read(queue->event_fd, &event, sizeof(event));
+        }
+    }
+
+    __atomic_store_n(&queue->is_consumer_waiting, 0, __ATOMIC_RELAXED);
+
+    return queue->head != __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
+
+
+void spsc_get_stats(SPSC_Queue *queue, SPSC_Queue_Stats *stats){
+
+    stats->capacity = queue->capacity;
+    stats->length = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) -
+                    __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    stats->high_watermark =
+        __atomic_load_n(&queue->high_watermark, __ATOMIC_RELAXED);
+    stats->overflow_count =
+        __atomic_load_n(&queue->overflow_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,247 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+  Project Name:
+
+     BeDIS
+
+  File Name:
+
+     SPSC_Queue.h
+
+  File Description:
+
+     This file contains the declarations and definition of variables used in
+     the SPSC_Queue.c file.
+
+  Version:
+
+      2.0, 20201016
+
+  Abstract:
+
+     BeDIS uses LBeacons to deliver 3D coordinates and textual descriptions of
+     their locations to users' devices. Basically, a LBeacon is an inexpensive,
+     Bluetooth Smart Ready device. The 3D coordinates and location description
+     of every LBeacon are retrieved from BeDIS (Building/environment Data and
+     Information System) and stored locally during deployment and maintenance
+     times. Once initialized, each LBeacon broadcasts its coordinates and
+     location description to Bluetooth enabled user devices within its coverage
+     area.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SPSC_QUEUE_SUCCESS 1
+#define SPSC_QUEUE_ERROR 0
+
+/* The size in bytes of a cache line. The indexes written by the producer and
+   by the consumer are kept in different cache lines to avoid false sharing. */
+#define SPSC_QUEUE_CACHE_LINE_SIZE 64
+
+/* The structure of the single-producer/single-consumer queue. The queue is a
+   ring of preallocated slots of identical size. The producer fills a slot in
+   place between spsc_reserve() and spsc_commit(), and the consumer reads a
+   slot in place between spsc_peek() and spsc_release(). Neither side takes a
+   lock. */
+typedef struct {
+
+    /* The buffer of all the slots in the ring */
+    char *slots;
+
+    /* The size of each slot in byte */
+    size_t size;
+
+    /* The number of slots in the ring. It is a power of two. */
+    unsigned int capacity;
+
+    /* The file descriptor of the eventfd used to wake up the consumer */
+    int event_fd;
+
+    /* The number of slots committed by the producer. Only the producer
+       writes this counter. */
+    unsigned int tail
+        __attribute__((aligned(SPSC_QUEUE_CACHE_LINE_SIZE)));
+
+    /* The maximum number of slots ever occupied at the same time */
+    unsigned int high_watermark;
+
+    /* The number of slots the producer failed to reserve because the ring
+       was full */
+    unsigned long overflow_count;
+
+    /* The number of slots released by the consumer. Only the consumer writes
+       this counter. */
+    unsigned int head
+        __attribute__((aligned(SPSC_QUEUE_CACHE_LINE_SIZE)));
+
+    /* The flag set by the consumer before it sleeps on event_fd */
+    int is_consumer_waiting;
+
+} SPSC_Queue;
+
+/* The structure of the statistics of a single-producer/single-consumer
+   queue */
+typedef struct {
+
+    unsigned int capacity;
+    unsigned int length;
+    unsigned int high_watermark;
+    unsigned long overflow_count;
+
+} SPSC_Queue_Stats;
+
+
+/*
+  spsc_init:
+
+     This function allocates the slots of the queue and creates the eventfd
+     used to wake up the consumer.
+
+  Parameters:
+
+     queue - pointer to a specific queue
+     size - the size of slots in the queue
+     slots - the number of slots in the queue. It is rounded up to a power of
+             two.
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int spsc_init(SPSC_Queue *queue, size_t size, size_t slots);
+
+
+/*
+  spsc_destroy:
+
+     This function frees the slots of the queue and closes its eventfd.
+
+  Parameters:
+
+     queue - pointer to the specific queue to be destroyed
+
+  Return value:
+
+     None
+ */
+void spsc_destroy(SPSC_Queue *queue);
+
+
+/*
+  spsc_reserve:
+
+     This function returns a pointer to the next free slot of the queue for
+     the producer to fill in, or NULL and counts an overflow when the queue is
+     full. The slot is not visible to the consumer until spsc_commit() is
+     called. [N.B. Only the producer thread calls this function.]
+
+  Parameters:
+
+     queue - pointer to the specific queue
+
+  Return value:
+
+     void - the pointer to the free slot or NULL
+ */
+void *spsc_reserve(SPSC_Queue *queue);
+
+
+/*
+  spsc_commit:
+
+     This function publishes the slot returned by the last spsc_reserve()
+     call to the consumer, and wakes up the consumer if it is waiting.
+     [N.B. Only the producer thread calls this function.]
+
+  Parameters:
+
+     queue - pointer to the specific queue
+
+  Return value:
+
+     None
+ */
+void spsc_commit(SPSC_Queue *queue);
+
+
+/*
+  spsc_peek:
+
+     This function returns a pointer to the oldest committed slot of the
+     queue, or NULL when the queue is empty. The slot stays valid until
+     spsc_release() is called. [N.B. Only the consumer thread calls this
+     function.]
+
+  Parameters:
+
+     queue - pointer to the specific queue
+
+  Return value:
+
+     void - the pointer to the oldest committed slot or NULL
+ */
+void *spsc_peek(SPSC_Queue *queue);
+
+
+/*
+  spsc_release:
+
+     This function returns the slot returned by the last spsc_peek() call to
+     the producer. [N.B. Only the consumer thread calls this function.]
+
+  Parameters:
+
+     queue - pointer to the specific queue
+
+  Return value:
+
+     None
+ */
+void spsc_release(SPSC_Queue *queue);
+
+
+/*
+  spsc_wait:
+
+     This function blocks the consumer until the queue is not empty or the
+     specified time has passed. [N.B. Only the consumer thread calls this
+     function.]
+
+  Parameters:
+
+     queue - pointer to the specific queue
+     timeout_in_ms - the maximum time in milliseconds to wait
+
+  Return value:
+
+     bool - true if the queue is not empty, false otherwise
+ */
+bool spsc_wait(SPSC_Queue *queue, int timeout_in_ms);
+
+
+/*
+  spsc_get_stats:
+
+     This function gets the current length, the high watermark and the
+     overflow count of the queue.
+
+  Parameters:
+
+     queue - pointer to the specific queue
+     stats - pointer to the struct to receive the statistics
+
+  Return value:
+
+     None
+ */
+void spsc_get_stats(SPSC_Queue *queue, SPSC_Queue_Stats *stats);
+
+#endif
@@ -124,22 +124,32 @@ sPkt udp_getrecv_without_encoding(pudp_config udp_config)
     return tmp;
 }
 
-int udp_addpkt(pudp_config udp_config, char *address, unsigned int port, 
-               char *content, int size)
+/* Prefix the content with its encoded sha256 hash, and return the size of
+   the result */
+static int udp_encode_pkt(char *content, char *ciphertext, 
+                          size_t ciphertext_size)
 {
     int ret = 0;
     char content_sha256[LENGTH_OF_SHA256];
-    char ciphertext[LENGTH_OF_ENCODED_WIFI_MESSAGE];
 
     memset(content_sha256, 0, sizeof(content_sha256));
     ret = SHA_256_Hash(content, content_sha256, sizeof(content_sha256));
     
-    memset(ciphertext, 0, sizeof(ciphertext));
-    ret = AES_ECB_Encoder_With_Token_Prefix(content_sha256, ciphertext, sizeof(ciphertext));
+    memset(ciphertext, 0, ciphertext_size);
+    ret = AES_ECB_Encoder_With_Token_Prefix(content_sha256, ciphertext, ciphertext_size);
 
     strcat(ciphertext, DELIMITER_SEMICOLON);
     strcat(ciphertext, content);
-    size = strlen(ciphertext);
+
+    return strlen(ciphertext);
+}
+
+int udp_addpkt(pudp_config udp_config, char *address, unsigned int port, 
+               char *content, int size)
+{
+    char ciphertext[LENGTH_OF_ENCODED_WIFI_MESSAGE];
+
+    size = udp_encode_pkt(content, ciphertext, sizeof(ciphertext));
     
     if(size > MESSAGE_LENGTH)
         return addpkt_msg_oversize;
@@ -149,6 +159,29 @@ int udp_addpkt(pudp_config udp_config, char *address, unsigned int port,
     return 0;
 }
 
+int udp_sendpkt(pudp_config udp_config, char *address, unsigned int port, 
+                char *content, int size)
+{
+    char ciphertext[LENGTH_OF_ENCODED_WIFI_MESSAGE];
+    struct sockaddr_in si_send;
+
+    size = udp_encode_pkt(content, ciphertext, sizeof(ciphertext));
+    
+    if(size > MESSAGE_LENGTH)
+        return addpkt_msg_oversize;
+
+    memset(&si_send, 0, sizeof(si_send));
+    si_send.sin_family = AF_INET;
+    si_send.sin_port   = htons(port);
+    si_send.sin_addr.s_addr   = inet_addr(address);
+
+    if (sendto(udp_config -> send_socket, ciphertext, size, 0,
+        (struct sockaddr *)&si_send, sizeof(struct sockaddr)) == -1)
+        return send_socket_error;
+
+    return 0;
+}
+
 
 sPkt udp_getrecv(pudp_config udp_config)
 {
@@ -195,6 +195,31 @@ int udp_addpkt(pudp_config udp_config, char *address, unsigned int port,
                char *content, int size);
 
 
+/*
+  udp_sendpkt
+
+     This function encodes the packet as udp_addpkt does and sends it right
+     away from the calling thread, so that it does not wait behind the 
+     packets in the pkt queue.
+
+  Parameter:
+
+     udp_config : The pointer points to the structure contains all variables 
+                  for the UDP connection.
+     port       : The port number to be sent to.
+     address    : The pointer points to the destnation address of the packet.
+     content    : The pointer points to the content we decided to send.
+     size       : The size of the content.
+
+  Return Value:
+
+     int : If return 0, everything work successfully.
+           If not 0   , something wrong.
+ */
+int udp_sendpkt(pudp_config udp_config, char *address, unsigned int port, 
+                char *content, int size);
+
+
 /*
   udp_getrecv
 
@@ -0,0 +1,556 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+Project Name:
+
+    BeDIS
+
+File Description:
+
+    This file contains the programs of the sources of HCI events read by the
+    scanning threads of LBeacon: the HCI socket of a Bluetooth dongle, a
+    replayer of btsnoop and pcap capture files, and a generator of synthetic
+    events for load testing without radios.
+
+File Name:
+
+    HCI_Transport.c
+
+Version:
+
+    2.0,  20201016
+
+Abstract:
+
+    BeDIS uses LBeacons to deliver 3D coordinates and textual
+    descriptions of their locations to users' devices. Basically, a
+    LBeacon is an inexpensive, Bluetooth Smart Ready device. The 3D
+    coordinates and location description of every LBeacon are retrieved
+    from BeDIS (Building/environment Data and Information System) and
+    stored locally during deployment and maintenance times. Once
+    initialized, each LBeacon broadcasts its coordinates and location
+    description to Bluetooth enabled user devices within its coverage
+    area.
+
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "HCI_Transport.h"
+
+/* The identification pattern at the start of a btsnoop file */
+#define BTSNOOP_IDENTIFICATION "btsnoop\0"
+#define BTSNOOP_HEADER_SIZE 16
+#define BTSNOOP_RECORD_HEADER_SIZE 24
+#define BTSNOOP_DATALINK_H4 1001
+#define BTSNOOP_DATALINK_HCI 1002
+
+/* The flags of a btsnoop record of an event received from the controller */
+#define BTSNOOP_FLAGS_EVENT 0x03
+
+#define PCAP_MAGIC 0xA1B2C3D4
+#define PCAP_MAGIC_SWAPPED 0xD4C3B2A1
+#define PCAP_HEADER_SIZE 24
+#define PCAP_RECORD_HEADER_SIZE 16
+#define PCAP_LINKTYPE_H4 187
+#define PCAP_LINKTYPE_H4_WITH_PHDR 201
+#define PCAP_PHDR_SIZE 4
+
+/* The payload of the advertising reports generated by the synthetic
+   transport: the flags AD structure and the 0xFF AD structure of the
+   BiDaETech tag format 05C6, whose last two bytes are the panic and the
+   battery voltage. */
+static const uint8_t synthetic_payload[] = {
+    0x02, 0x01, 0x06,
+    0x07, 0xFF, 0x0D, 0x00, 0x05, 0xC6, 0x00, 0x1E
+};
+
+#define SYNTHETIC_PAYLOAD_INDEX_OF_PANIC 9
+
+/* The size of an inquiry result with RSSI */
+#define INQUIRY_INFO_WITH_RSSI_SIZE 14
+
+
+/* A static function reading a 32-bit big-endian integer. */
+static inline uint32_t get_be32(uint8_t *data){
+
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+           ((uint32_t)data[2] << 8) | data[3];
+}
+
+
+/* A static function reading a 32-bit integer of a pcap file. */
+static inline uint32_t get_pcap32(HCI_Transport *transport, uint8_t *data){
+
+    uint32_t value;
+
+    memcpy(&value, data, sizeof(value));
+
+    if(transport->is_pcap_swapped)
+        return __builtin_bswap32(value);
+
+    return value;
+}
+
+
+int ht_open_socket(HCI_Transport *transport, int dongle_device_id){
+
+    memset(transport, 0, sizeof(HCI_Transport));
+
+    transport->type = HCI_TRANSPORT_SOCKET;
+    transport->socket = hci_open_dev(dongle_device_id);
+
+    if(transport->socket < 0)
+        return HCI_TRANSPORT_ERROR;
+
+    return HCI_TRANSPORT_SUCCESS;
+}
+
+
+int ht_open_replay(HCI_Transport *transport, char *file_name){
+
+    uint8_t header[BTSNOOP_HEADER_SIZE > PCAP_HEADER_SIZE ?
+                   BTSNOOP_HEADER_SIZE : PCAP_HEADER_SIZE];
+    uint32_t magic;
+    uint32_t datalink;
+
+    memset(transport, 0, sizeof(HCI_Transport));
+
+    transport->type = HCI_TRANSPORT_REPLAY;
+    transport->socket = -1;
+
+    transport->replay_file = fopen(file_name, "rb");
+
+    if(transport->replay_file == NULL)
+        return HCI_TRANSPORT_ERROR;
+
+    if(BTSNOOP_HEADER_SIZE !=
+       fread(header, 1, BTSNOOP_HEADER_SIZE, transport->replay_file))
+        goto failed;
+
+    if(0 == memcmp(header, BTSNOOP_IDENTIFICATION, 8)){
+
+        datalink = get_be32(&header[12]);
+
+        if(datalink == BTSNOOP_DATALINK_H4)
+            transport->replay_format = HCI_REPLAY_BTSNOOP_H4;
+        else if(datalink == BTSNOOP_DATALINK_HCI)
+            transport->replay_format = HCI_REPLAY_BTSNOOP_HCI;
+        else
+            goto failed;
+
+        transport->first_record_offset = BTSNOOP_HEADER_SIZE;
+
+        return HCI_TRANSPORT_SUCCESS;
+    }
+
+    memcpy(&magic, header, sizeof(magic));
+
+    if(magic == PCAP_MAGIC)
+        transport->is_pcap_swapped = false;
+    else if(magic == PCAP_MAGIC_SWAPPED)
+        transport->is_pcap_swapped = true;
+    else
+        goto failed;
+
+    if(PCAP_HEADER_SIZE - BTSNOOP_HEADER_SIZE !=
+       fread(&header[BTSNOOP_HEADER_SIZE], 1,
+             PCAP_HEADER_SIZE - BTSNOOP_HEADER_SIZE, transport->replay_file))
+        goto failed;
+
+    datalink = get_pcap32(transport, &header[20]);
+
+    if(datalink == PCAP_LINKTYPE_H4)
+        transport->replay_format = HCI_REPLAY_PCAP_H4;
+    else if(datalink == PCAP_LINKTYPE_H4_WITH_PHDR)
+        transport->replay_format = HCI_REPLAY_PCAP_H4_WITH_PHDR;
+    else
+        goto failed;
+
+    transport->first_record_offset = PCAP_HEADER_SIZE;
+
+    return HCI_TRANSPORT_SUCCESS;
+
+failed:
+    fclose(transport->replay_file);
+    transport->replay_file = NULL;
+    return HCI_TRANSPORT_ERROR;
+}
+
+
+int ht_open_synthetic(HCI_Transport *transport,
+                      uint8_t event_code,
+                      unsigned int number_tags,
+                      unsigned int adverts_per_second){
+
+    memset(transport, 0, sizeof(HCI_Transport));
+
+    transport->type = HCI_TRANSPORT_SYNTHETIC;
+    transport->socket = -1;
+
+    if(event_code != EVT_LE_META_EVENT &&
+       event_code != EVT_INQUIRY_RESULT_WITH_RSSI)
+        return HCI_TRANSPORT_ERROR;
+
+    if(number_tags == 0 || number_tags > HCI_SYNTHETIC_MAX_TAGS)
+        return HCI_TRANSPORT_ERROR;
+
+    transport->synthetic_event = event_code;
+    transport->number_tags = number_tags;
+    transport->adverts_per_second = adverts_per_second;
+    transport->number_adverts = 0;
+    transport->random_seed = (unsigned int)time(NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &transport->start_time);
+
+    return HCI_TRANSPORT_SUCCESS;
+}
+
+
+/* A static function reading an event from the HCI socket. */
+static int read_socket_event(HCI_Transport *transport,
+                             uint8_t *buffer,
+                             size_t buffer_length,
+                             int timeout_in_ms){
+
+    struct pollfd event_poll;
+    int ret;
+
+    event_poll.fd = transport->socket;
+    event_poll.events = POLLIN | POLLERR | POLLHUP;
+    event_poll.revents = 0;
+
+    ret = poll(&event_poll, 1, timeout_in_ms);
+
+    if(ret == 0 || (ret < 0 && errno == EINTR))
+        return 0;
+
+    if(ret < 0)
+        return -1;
+
+    ret = read(transport->socket, buffer, buffer_length);
+
+    if(ret < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+
+    return ret;
+}
+
+
+/* A static function reading the next event record from the capture file.
+   It returns 0 at the end of file and skips records other than events. */
+static int read_replay_record(HCI_Transport *transport,
+                              uint8_t *buffer,
+                              size_t buffer_length){
+
+    uint8_t header[BTSNOOP_RECORD_HEADER_SIZE];
+    uint8_t packet[HCI_MAX_EVENT_SIZE + PCAP_PHDR_SIZE + 1];
+    uint8_t *event;
+    uint32_t included_length;
+    uint32_t flags = 0;
+    size_t event_length;
+    size_t record_header_size;
+
+    if(transport->replay_format == HCI_REPLAY_BTSNOOP_H4 ||
+       transport->replay_format == HCI_REPLAY_BTSNOOP_HCI)
+        record_header_size = BTSNOOP_RECORD_HEADER_SIZE;
+    else
+        record_header_size = PCAP_RECORD_HEADER_SIZE;
+
+    while(record_header_size ==
+          fread(header, 1, record_header_size, transport->replay_file)){
+
+        if(record_header_size == BTSNOOP_RECORD_HEADER_SIZE){
+            included_length = get_be32(&header[4]);
+            flags = get_be32(&header[8]);
+        }else{
+            included_length = get_pcap32(transport, &header[8]);
+        }
+
+        /* Skip the records too large to be an HCI event */
+        if(included_length > sizeof(packet)){
+
+            if(0 != fseek(transport->replay_file, included_length, SEEK_CUR))
+                return -1;
+            continue;
+        }
+
+        if(included_length !=
+           fread(packet, 1, included_length, transport->replay_file))
+            return 0;
+
+        event = packet;
+        event_length = included_length;
+
+        switch(transport->replay_format){
+            case HCI_REPLAY_BTSNOOP_HCI:
+
+                /* The packet type is given by the flags instead of the
+                first byte of the packet */
+                if((flags & BTSNOOP_FLAGS_EVENT) != BTSNOOP_FLAGS_EVENT)
+                    continue;
+
+                if(event_length + 1 > buffer_length)
+                    continue;
+
+                buffer[0] = HCI_EVENT_PKT;
+                memcpy(&buffer[1], event, event_length);
+
+                return event_length + 1;
+
+            case HCI_REPLAY_PCAP_H4_WITH_PHDR:
+
+                if(event_length < PCAP_PHDR_SIZE)
+                    continue;
+
+                event += PCAP_PHDR_SIZE;
+                event_length -= PCAP_PHDR_SIZE;
+                break;
+
+            default:
+                break;
+        }
+
+        if(event_length < 1 + HCI_EVENT_HDR_SIZE ||
+           event[0] != HCI_EVENT_PKT || event_length > buffer_length)
+            continue;
+
+        memcpy(buffer, event, event_length);
+
+        return event_length;
+    }
+
+    return 0;
+}
+
+
+/* A static function reading the next event from the capture file, rewinding
+   it at the end of file. */
+static int read_replay_event(HCI_Transport *transport,
+                             uint8_t *buffer,
+                             size_t buffer_length){
+
+    int ret;
+
+    ret = read_replay_record(transport, buffer, buffer_length);
+
+    if(ret != 0){
+
+        if(ret > 0)
+            transport->events_in_pass++;
+
+        return ret;
+    }
+
+    /* A file without any event would be rewound forever */
+    if(transport->events_in_pass == 0)
+        return -1;
+
+    transport->events_in_pass = 0;
+
+    if(0 != fseek(transport->replay_file,
+                  transport->first_record_offset, SEEK_SET))
+        return -1;
+
+    ret = read_replay_record(transport, buffer, buffer_length);
+
+    if(ret > 0)
+        transport->events_in_pass++;
+
+    return ret;
+}
+
+
+/* A static function waiting until the synthetic transport is due to emit
+   its next report. It returns false if the report is not due within the
+   timeout. */
+static bool wait_synthetic_schedule(HCI_Transport *transport,
+                                    int timeout_in_ms){
+
+    struct timespec now;
+    struct timespec sleep_time;
+    uint64_t due_in_ns;
+    uint64_t elapsed_in_ns;
+    uint64_t wait_in_ns;
+
+    if(transport->adverts_per_second == 0)
+        return true;
+
+    due_in_ns = transport->number_adverts * 1000000000ULL /
+                transport->adverts_per_second;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    elapsed_in_ns =
+        (uint64_t)(now.tv_sec - transport->start_time.tv_sec) * 1000000000ULL +
+        now.tv_nsec - transport->start_time.tv_nsec;
+
+    if(elapsed_in_ns >= due_in_ns)
+        return true;
+
+    wait_in_ns = due_in_ns - elapsed_in_ns;
+
+    if(wait_in_ns > (uint64_t)timeout_in_ms * 1000000ULL){
+
+        wait_in_ns = (uint64_t)timeout_in_ms * 1000000ULL;
+        sleep_time.tv_sec = wait_in_ns / 1000000000ULL;
+        sleep_time.tv_nsec = wait_in_ns % 1000000000ULL;
+        nanosleep(&sleep_time, NULL);
+
+        return false;
+    }
+
+    sleep_time.tv_sec = wait_in_ns / 1000000000ULL;
+    sleep_time.tv_nsec = wait_in_ns % 1000000000ULL;
+    nanosleep(&sleep_time, NULL);
+
+    return true;
+}
+
+
+/* A static function filling in the bdaddr_t of a synthetic tag. */
+static void get_synthetic_address(unsigned int tag, bdaddr_t *bdaddr){
+
+    uint64_t mac_key = HCI_SYNTHETIC_MAC_ADDRESS_PREFIX | tag;
+    size_t i;
+
+    /* bdaddr_t stores the least significant byte first */
+    for(i = 0 ; i < sizeof(bdaddr->b) ; i++){
+        bdaddr->b[i] = (mac_key >> (8 * i)) & 0xFF;
+    }
+}
+
+
+/* A static function generating an event of synthetic reports. */
+static int read_synthetic_event(HCI_Transport *transport,
+                                uint8_t *buffer,
+                                size_t buffer_length,
+                                int timeout_in_ms){
+
+    le_advertising_info *info;
+    inquiry_info_with_rssi *info_rssi;
+    uint8_t *report_pointer;
+    unsigned int tag;
+    unsigned int round;
+    int number_reports;
+    size_t report_size;
+
+    if(transport->synthetic_event == EVT_LE_META_EVENT){
+
+        report_size = LE_ADVERTISING_INFO_SIZE + sizeof(synthetic_payload) + 1;
+        /* The event header, the subevent code and the number of reports */
+        report_pointer = buffer + 1 + HCI_EVENT_HDR_SIZE + 2;
+    }else{
+
+        report_size = INQUIRY_INFO_WITH_RSSI_SIZE;
+        /* The event header and the number of responses */
+        report_pointer = buffer + 1 + HCI_EVENT_HDR_SIZE + 1;
+    }
+
+    if(report_pointer + report_size * HCI_SYNTHETIC_REPORTS_PER_EVENT >
+       buffer + buffer_length)
+        return -1;
+
+    for(number_reports = 0 ;
+        number_reports < HCI_SYNTHETIC_REPORTS_PER_EVENT ;
+        number_reports++){
+
+        /* Emit the reports due so far, and wait for the first one only */
+        if(number_reports == 0){
+            if(!wait_synthetic_schedule(transport, timeout_in_ms))
+                return 0;
+        }else if(!wait_synthetic_schedule(transport, 0)){
+            break;
+        }
+
+        tag = transport->number_adverts % transport->number_tags;
+        round = transport->number_adverts / transport->number_tags;
+        transport->number_adverts++;
+
+        if(transport->synthetic_event == EVT_LE_META_EVENT){
+
+            info = (le_advertising_info *) report_pointer;
+            info->evt_type = 0x03; /* ADV_NONCONN_IND */
+            info->bdaddr_type = LE_PUBLIC_ADDRESS;
+            get_synthetic_address(tag, &info->bdaddr);
+            info->length = sizeof(synthetic_payload);
+            memcpy(info->data, synthetic_payload, sizeof(synthetic_payload));
+
+            /* Press the panic button of a few tags in each round */
+            if((round + tag) % 100 == 0)
+                info->data[SYNTHETIC_PAYLOAD_INDEX_OF_PANIC] = 0x01;
+
+            /* the rssi is in the next byte after the packet */
+            info->data[info->length] =
+                (int8_t)(-40 - rand_r(&transport->random_seed) % 50);
+        }else{
+
+            info_rssi = (inquiry_info_with_rssi *) report_pointer;
+            memset(info_rssi, 0, INQUIRY_INFO_WITH_RSSI_SIZE);
+            get_synthetic_address(tag, &info_rssi->bdaddr);
+            info_rssi->rssi =
+                (int8_t)(-40 - rand_r(&transport->random_seed) % 50);
+        }
+
+        report_pointer += report_size;
+    }
+
+    buffer[0] = HCI_EVENT_PKT;
+    buffer[1] = transport->synthetic_event;
+
+    if(transport->synthetic_event == EVT_LE_META_EVENT){
+        buffer[3] = EVT_LE_ADVERTISING_REPORT;
+        buffer[4] = number_reports;
+    }else{
+        buffer[3] = number_reports;
+    }
+
+    /* The parameter length excludes the packet type and the event header */
+    buffer[2] = report_pointer - buffer - 1 - HCI_EVENT_HDR_SIZE;
+
+    return report_pointer - buffer;
+}
+
+
+int ht_read_event(HCI_Transport *transport,
+                  uint8_t *buffer,
+                  size_t buffer_length,
+                  int timeout_in_ms){
+
+    switch(transport->type){
+        case HCI_TRANSPORT_SOCKET:
+            return read_socket_event(transport, buffer, buffer_length,
+                                     timeout_in_ms);
+        case HCI_TRANSPORT_REPLAY:
+            return read_replay_event(transport, buffer, buffer_length);
+        case HCI_TRANSPORT_SYNTHETIC:
+            return read_synthetic_event(transport, buffer, buffer_length,
+                                        timeout_in_ms);
+        default:
+            return -1;
+    }
+}
+
+
+void ht_close(HCI_Transport *transport){
+
+    switch(transport->type){
+        case HCI_TRANSPORT_SOCKET:
+            if(transport->socket >= 0)
+                hci_close_dev(transport->socket);
+            break;
+        case HCI_TRANSPORT_REPLAY:
+            if(transport->replay_file != NULL)
+                fclose(transport->replay_file);
+            break;
+        default:
+            break;
+    }
+
+    transport->socket = -1;
+    transport->replay_file = NULL;
+}
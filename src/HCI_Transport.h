@@ -0,0 +1,237 @@
+/*
+  2020 © Copyright (c) BiDaE Technology Inc.
+  Provided under BiDaE SHAREWARE LICENSE-1.0 in the LICENSE.
+
+Project Name:
+
+    BeDIS
+
+File Description:
+
+    This header file contains declarations of variables, structs and
+    functions used in the HCI_Transport.c file.
+
+File Name:
+
+    HCI_Transport.h
+
+Version:
+
+    2.0,  20201016
+
+Abstract:
+
+    BeDIS uses LBeacons to deliver 3D coordinates and textual
+    descriptions of their locations to users' devices. Basically, a
+    LBeacon is an inexpensive, Bluetooth Smart Ready device. The 3D
+    coordinates and location description of every LBeacon are retrieved
+    from BeDIS (Building/environment Data and Information System) and
+    stored locally during deployment and maintenance times. Once
+    initialized, each LBeacon broadcasts its coordinates and location
+    description to Bluetooth enabled user devices within its coverage
+    area.
+
+*/
+
+#ifndef HCI_TRANSPORT_H
+#define HCI_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+#define HCI_TRANSPORT_SUCCESS 1
+#define HCI_TRANSPORT_ERROR 0
+
+/* The number of advertising reports or inquiry responses batched in one
+   event by the synthetic generator */
+#define HCI_SYNTHETIC_REPORTS_PER_EVENT 4
+
+/* The MAC address prefix of the tags emitted by the synthetic generator. The
+   index of a tag fills in the lower 24 bits. */
+#define HCI_SYNTHETIC_MAC_ADDRESS_PREFIX 0xC10000000000ULL
+
+/* The maximum number of tags emitted by the synthetic generator */
+#define HCI_SYNTHETIC_MAX_TAGS 0x1000000
+
+/* The file formats supported by the replay transport */
+typedef enum HCIReplayFormat {
+
+    /* btsnoop with H4 packets, datalink 1001 */
+    HCI_REPLAY_BTSNOOP_H4 = 0,
+    /* btsnoop with un-encapsulated HCI packets, datalink 1002 */
+    HCI_REPLAY_BTSNOOP_HCI = 1,
+    /* pcap with H4 packets, linktype 187 */
+    HCI_REPLAY_PCAP_H4 = 2,
+    /* pcap with H4 packets following a 4-byte direction header,
+       linktype 201 */
+    HCI_REPLAY_PCAP_H4_WITH_PHDR = 3
+
+} HCIReplayFormat;
+
+/* The backends of an HCI transport */
+typedef enum HCITransportType {
+
+    /* The HCI socket of a real Bluetooth dongle */
+    HCI_TRANSPORT_SOCKET = 0,
+    /* A btsnoop or pcap capture file replayed as fast as possible */
+    HCI_TRANSPORT_REPLAY = 1,
+    /* A generator of events from a configurable number of tags at a
+       configurable rate */
+    HCI_TRANSPORT_SYNTHETIC = 2
+
+} HCITransportType;
+
+/* Struct for the source of HCI events read by the scanning threads. Events
+   are always returned in H4 format, i.e. starting with the HCI_EVENT_PKT
+   packet type byte, no matter which backend produced them. */
+typedef struct HCI_Transport {
+
+    HCITransportType type;
+
+    /* The HCI socket. It is -1 if the transport does not talk to a
+       controller, in which case no HCI commands may be sent. */
+    int socket;
+
+    /* The capture file of the replay transport */
+    FILE *replay_file;
+    HCIReplayFormat replay_format;
+
+    /* Whether the fields of the pcap file are in the opposite byte order */
+    bool is_pcap_swapped;
+
+    /* The file offset of the first record, to rewind to at the end of file */
+    long first_record_offset;
+
+    /* The number of events returned since the last rewind */
+    unsigned long events_in_pass;
+
+    /* The event code generated by the synthetic transport, either
+       EVT_LE_META_EVENT or EVT_INQUIRY_RESULT_WITH_RSSI */
+    uint8_t synthetic_event;
+
+    /* The number of distinct tags of the synthetic transport */
+    unsigned int number_tags;
+
+    /* The rate of the synthetic transport. 0 means as fast as possible. */
+    unsigned int adverts_per_second;
+
+    /* The number of adverts generated since the transport is opened */
+    unsigned long number_adverts;
+
+    /* The time the synthetic transport is opened */
+    struct timespec start_time;
+
+    /* The seed of the random RSSI values */
+    unsigned int random_seed;
+
+} HCI_Transport;
+
+
+/*
+  ht_open_socket:
+
+     This function opens the HCI socket of a Bluetooth dongle as the
+     transport.
+
+  Parameters:
+
+     transport - pointer to the transport to be opened
+     dongle_device_id - the id of the Bluetooth dongle
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int ht_open_socket(HCI_Transport *transport, int dongle_device_id);
+
+
+/*
+  ht_open_replay:
+
+     This function opens a btsnoop or pcap capture file as the transport. The
+     format of the file is detected from its header. The file is replayed as
+     fast as possible and rewound at its end.
+
+  Parameters:
+
+     transport - pointer to the transport to be opened
+     file_name - the path name of the capture file
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int ht_open_replay(HCI_Transport *transport, char *file_name);
+
+
+/*
+  ht_open_synthetic:
+
+     This function opens a generator of HCI events as the transport. The
+     LE advertising reports carry the 0xFF payload of the BiDaETech tag
+     format 05C6, and the MAC addresses of the tags start with
+     HCI_SYNTHETIC_MAC_ADDRESS_PREFIX.
+
+  Parameters:
+
+     transport - pointer to the transport to be opened
+     event_code - EVT_LE_META_EVENT for LE advertising reports or
+                  EVT_INQUIRY_RESULT_WITH_RSSI for BR/EDR inquiry results
+     number_tags - the number of distinct tags
+     adverts_per_second - the number of reports generated per second, or 0
+                          to generate them as fast as possible
+
+  Return value:
+
+     Status - the error code or the successful message
+ */
+int ht_open_synthetic(HCI_Transport *transport,
+                      uint8_t event_code,
+                      unsigned int number_tags,
+                      unsigned int adverts_per_second);
+
+
+/*
+  ht_read_event:
+
+     This function reads the next HCI event from the transport.
+
+  Parameters:
+
+     transport - pointer to the specific transport
+     buffer - the buffer to receive the event in H4 format
+     buffer_length - the length in number of bytes of the buffer
+     timeout_in_ms - the maximum time in milliseconds to wait for an event
+
+  Return value:
+
+     int - the length of the event in number of bytes, 0 if no event is
+           available within the timeout, or -1 if the transport fails
+ */
+int ht_read_event(HCI_Transport *transport,
+                  uint8_t *buffer,
+                  size_t buffer_length,
+                  int timeout_in_ms);
+
+
+/*
+  ht_close:
+
+     This function closes the transport.
+
+  Parameters:
+
+     transport - pointer to the transport to be closed
+
+  Return value:
+
+     None
+ */
+void ht_close(HCI_Transport *transport);
+
+#endif
@@ -203,12 +203,16 @@ ErrorCode get_config(Config *config, char *file_name) {
     int number_mac_prefix = 0;
     int number_device_name_prefix = 0;
     int i;
+    size_t j;
+    int k;
+    int priority;
     struct PrefixRule *mac_prefix_node;
     struct DeviceNamePrefix *device_name_node;
     struct List_Entry *current_list_entry;
     char single_prefix[CONFIG_BUFFER_SIZE];
     char *prefix_current_ptr = NULL;
     char *prefix_save_current_ptr = NULL;    
+    char mac_prefix_digits[LENGTH_OF_MAC_ADDRESS];
 
 
     retry_times = FILE_OPEN_RETRY;
@@ -329,10 +333,58 @@ ErrorCode get_config(Config *config, char *file_name) {
                 prefix_current_ptr, 
                 strlen(prefix_current_ptr));
 
+        /* Convert the rule to bytes and integers once here, so that the 
+        examining thread compares the MAC address in bytes. */
+        memset(mac_prefix_digits, 0, sizeof(mac_prefix_digits));
+        for(j = 0, k = 0 ; j < strlen(mac_prefix_node->prefix) ; j++){
+            /* Skip the ':' separators between bytes */
+            if(isxdigit(mac_prefix_node->prefix[j]))
+                mac_prefix_digits[k++] = mac_prefix_node->prefix[j];
+        }
+        if(WORK_SUCCESSFULLY != 
+           convert_hex_to_prefix(mac_prefix_digits, 
+                                 &mac_prefix_node->mac_prefix)){
+            zlog_error(category_health_report,
+                       "Invalid mac prefix [%s]",
+                       mac_prefix_node->prefix);
+            zlog_error(category_debug,
+                       "Invalid mac prefix [%s]",
+                       mac_prefix_node->prefix);
+            free(mac_prefix_node);
+            continue;
+        }
+        mac_prefix_node->identifier_value = 
+            strtol(mac_prefix_node->identifier, NULL, 16);
+        mac_prefix_node->decoder = 
+            get_tag_decoder(mac_prefix_node->identifier_value);
+
+        if(BLE_PAYLOAD_IDENTIFIER_NO_PARSE != 
+           mac_prefix_node->identifier_value &&
+           NULL == mac_prefix_node->decoder){
+            zlog_error(category_health_report,
+                       "Unsupported tag identifier [%s]",
+                       mac_prefix_node->identifier);
+            zlog_error(category_debug,
+                       "Unsupported tag identifier [%s]",
+                       mac_prefix_node->identifier);
+        }
+
         insert_list_tail(&mac_prefix_node->list_entry,
                          &config->mac_prefix_list_head);
     }
 
+    /* compile the list of acceptable mac prefixes into a trie, so that a 
+    MAC address is classified in a single pass over its digits */
+    if(PREFIX_TRIE_SUCCESS != pt_init(&config->mac_prefix_trie)){
+        zlog_error(category_health_report,
+                   "Unable to initialize the trie of mac prefixes");
+        zlog_error(category_debug,
+                   "Unable to initialize the trie of mac prefixes");
+        fclose(file);
+        return E_MALLOC;
+    }
+
+    priority = 0;
     list_for_each(current_list_entry, &config->mac_prefix_list_head){
         mac_prefix_node = ListEntry(current_list_entry, PrefixRule,
                                     list_entry);
@@ -340,6 +392,22 @@ ErrorCode get_config(Config *config, char *file_name) {
                    "mac address with prefix [%s] and identifie [%s]",
                    mac_prefix_node->prefix,
                    mac_prefix_node->identifier);
+
+        if(PREFIX_TRIE_SUCCESS != 
+           pt_insert(&config->mac_prefix_trie,
+                     mac_prefix_node->mac_prefix.bytes,
+                     mac_prefix_node->mac_prefix.number_digits,
+                     mac_prefix_node,
+                     priority++)){
+            zlog_error(category_health_report,
+                       "Unable to insert mac prefix [%s] into the trie",
+                       mac_prefix_node->prefix);
+            zlog_error(category_debug,
+                       "Unable to insert mac prefix [%s] into the trie",
+                       mac_prefix_node->prefix);
+            fclose(file);
+            return E_MALLOC;
+        }
     }
 
     /* item 15 */
@@ -390,15 +458,62 @@ ErrorCode get_config(Config *config, char *file_name) {
                                          &prefix_save_current_ptr);
 
         device_name_node->is_scan_rsp_needed = atoi(prefix_current_ptr);
+
+        /* Convert the rule to bytes and integers once here, so that the 
+        examining thread compares the advertisement in bytes. */
+        if(WORK_SUCCESSFULLY != 
+           convert_hex_to_prefix(device_name_node->prefix,
+                                 &device_name_node->name_prefix)){
+            zlog_error(category_health_report,
+                       "Invalid device name prefix [%s]",
+                       device_name_node->prefix);
+            zlog_error(category_debug,
+                       "Invalid device name prefix [%s]",
+                       device_name_node->prefix);
+            free(device_name_node);
+            continue;
+        }
+        device_name_node->identifier_value = 
+            strtol(device_name_node->identifier, NULL, 16);
+        device_name_node->decoder = 
+            get_tag_decoder(device_name_node->identifier_value);
+
+        if(BLE_PAYLOAD_IDENTIFIER_NO_PARSE != 
+           device_name_node->identifier_value &&
+           NULL == device_name_node->decoder){
+            zlog_error(category_health_report,
+                       "Unsupported tag identifier [%s]",
+                       device_name_node->identifier);
+            zlog_error(category_debug,
+                       "Unsupported tag identifier [%s]",
+                       device_name_node->identifier);
+        }
         
         insert_list_tail(&device_name_node->list_entry,
                          &config->device_name_prefix_list_head);
     }
 
+    /* compile the list of acceptable device name prefixes into a trie, so 
+    that a device name is classified in a single pass over its bytes */
+    if(PREFIX_TRIE_SUCCESS != pt_init(&config->device_name_prefix_trie)){
+        zlog_error(category_health_report,
+                   "Unable to initialize the trie of device name prefixes");
+        zlog_error(category_debug,
+                   "Unable to initialize the trie of device name prefixes");
+        fclose(file);
+        return E_MALLOC;
+    }
+
+    priority = 0;
+    config->is_active_scan_needed = false;
     list_for_each(current_list_entry, &config->device_name_prefix_list_head){
         device_name_node = ListEntry(current_list_entry, 
                                      DeviceNamePrefix,
                                      list_entry);
+
+        if(device_name_node->is_scan_rsp_needed)
+            config->is_active_scan_needed = true;
+
         zlog_debug(category_debug, 
                    "device name with prefix [%s], identifer [%s], payload[%d], scan_rsp[%d]",
                    device_name_node->prefix, 
@@ -406,6 +521,22 @@ ErrorCode get_config(Config *config, char *file_name) {
                    device_name_node->is_payload_needed,
                    device_name_node->is_scan_rsp_needed
                    );
+
+        if(PREFIX_TRIE_SUCCESS != 
+           pt_insert(&config->device_name_prefix_trie,
+                     device_name_node->name_prefix.bytes,
+                     device_name_node->name_prefix.number_digits,
+                     device_name_node,
+                     priority++)){
+            zlog_error(category_health_report,
+                       "Unable to insert device name prefix [%s] into the "
+                       "trie", device_name_node->prefix);
+            zlog_error(category_debug,
+                       "Unable to insert device name prefix [%s] into the "
+                       "trie", device_name_node->prefix);
+            fclose(file);
+            return E_MALLOC;
+        }
     }
     
     /* item 16 */
@@ -432,34 +563,278 @@ ErrorCode get_config(Config *config, char *file_name) {
               config->gateway_addr, config->gateway_port,
               config->local_client_port);
 
+    /* item 19 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_hci_transport = atoi(config_message);
+
+    /* item 20 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    memset(config->scan_hci_replay_file, 0, 
+           sizeof(config->scan_hci_replay_file));
+    memcpy(config->scan_hci_replay_file, config_message, 
+           strlen(config_message));
+
+    /* item 21 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_synthetic_number_tags = atoi(config_message);
+
+    /* item 22 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_synthetic_adverts_per_second = atoi(config_message);
+
+    zlog_info(category_debug,
+              "HCI transport=[%d], replay_file=[%s], synthetic tags=[%d], "
+              "adverts_per_second=[%d]",
+              config->scan_hci_transport, config->scan_hci_replay_file,
+              config->scan_synthetic_number_tags,
+              config->scan_synthetic_adverts_per_second);
+
+    /* item 23 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_accept_list_enabled = atoi(config_message);
+
+    /* item 24 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_duplicate_filter_enabled = atoi(config_message);
+
+    /* item 25 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_rearm_interval_in_sec = atoi(config_message);
+
+    /* item 26 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_discovery_interval_in_sec = atoi(config_message);
+
+    zlog_info(category_debug,
+              "Scan accept_list=[%d], duplicate_filter=[%d], "
+              "rearm_interval=[%d], discovery_interval=[%d]",
+              config->scan_accept_list_enabled,
+              config->scan_duplicate_filter_enabled,
+              config->scan_rearm_interval_in_sec,
+              config->scan_discovery_interval_in_sec);
+
+    /* item 27 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_hybrid_enabled = atoi(config_message);
+
+    /* item 28 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_hybrid_active_window_in_sec = atoi(config_message);
+
+    /* item 29 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_hybrid_passive_window_in_sec = atoi(config_message);
+
+    zlog_info(category_debug,
+              "Scan active=[%d], hybrid=[%d], active_window=[%d], "
+              "passive_window=[%d]",
+              config->is_active_scan_needed,
+              config->scan_hybrid_enabled,
+              config->scan_hybrid_active_window_in_sec,
+              config->scan_hybrid_passive_window_in_sec);
+
+    /* item 30 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->number_examine_workers = atoi(config_message);
+
+    if(config->number_examine_workers < 1 || 
+       config->number_examine_workers > MAX_NUMBER_EXAMINE_WORKERS){
+
+        zlog_warn(category_health_report,
+                  "Invalid number_examine_workers=[%d], use [%d] instead",
+                  config->number_examine_workers, 
+                  max(1, min(config->number_examine_workers,
+                             MAX_NUMBER_EXAMINE_WORKERS)));
+        zlog_warn(category_debug,
+                  "Invalid number_examine_workers=[%d], use [%d] instead",
+                  config->number_examine_workers, 
+                  max(1, min(config->number_examine_workers,
+                             MAX_NUMBER_EXAMINE_WORKERS)));
+
+        config->number_examine_workers = 
+            max(1, min(config->number_examine_workers, 
+                       MAX_NUMBER_EXAMINE_WORKERS));
+    }
+
+    zlog_info(category_debug, "Examine workers=[%d]", 
+              config->number_examine_workers);
+
+    /* item 31 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->delta_reporting_enabled = atoi(config_message);
+
+    /* item 32 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->delta_rssi_band_in_db = max(1, atoi(config_message));
+
+    /* item 33 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->delta_heartbeat_interval_in_sec = atoi(config_message);
+
+    /* item 34 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->delta_left_timeout_in_sec = atoi(config_message);
+
+    zlog_info(category_debug,
+              "Delta reporting=[%d], rssi_band=[%d], heartbeat_interval=[%d], "
+              "left_timeout=[%d]",
+              config->delta_reporting_enabled,
+              config->delta_rssi_band_in_db,
+              config->delta_heartbeat_interval_in_sec,
+              config->delta_left_timeout_in_sec);
+
+    /* item 35 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->panic_alert_enabled = atoi(config_message);
+
+    /* item 36 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->panic_debounce_interval_in_sec = atoi(config_message);
+
+    zlog_info(category_debug,
+              "Panic alert=[%d], debounce_interval=[%d]",
+              config->panic_alert_enabled,
+              config->panic_debounce_interval_in_sec);
+
+    /* item 37 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_coalescing_enabled = atoi(config_message);
+
+    /* item 38 */
+    fetch_next_string(file, config_message, sizeof(config_message)); 
+    config->scan_coalescing_window_in_ms = max(1, atoi(config_message));
+
+    zlog_info(category_debug,
+              "Scan coalescing=[%d], window=[%d] ms",
+              config->scan_coalescing_enabled,
+              config->scan_coalescing_window_in_ms);
+
     fclose(file);
 
     return WORK_SUCCESSFULLY;
 }
 
-void send_to_push_dongle(char * mac_address,
+void init_rssi_stats(RssiStats *stats, int rssi){
+
+    stats->count = 1;
+    stats->min = rssi;
+    stats->max = rssi;
+    stats->first = rssi;
+    stats->mean = rssi;
+    stats->m2 = 0;
+    stats->ewma = rssi;
+}
+
+void merge_rssi_stats(RssiStats *stats, RssiStats *other){
+    unsigned int count = stats->count + other->count;
+    float delta = other->mean - stats->mean;
+    float decay = 1;
+    unsigned int i;
+
+    if(other->min < stats->min)
+        stats->min = other->min;
+    if(other->max > stats->max)
+        stats->max = other->max;
+
+    stats->m2 += other->m2 + 
+                 delta * delta * stats->count * other->count / count;
+    stats->mean += delta * other->count / count;
+    stats->count = count;
+
+    /* The moving average of the other values starts from their first value
+    instead of the moving average of the device. Adding them one by one 
+    would decay the difference once per value. */
+    for(i = 0 ; i < other->count ; i++)
+        decay *= 1 - RSSI_EWMA_WEIGHT;
+
+    stats->ewma = other->ewma + decay * (stats->ewma - other->first);
+}
+
+float get_rssi_variance(RssiStats *stats){
+
+    if(stats->count < 2)
+        return 0;
+
+    return stats->m2 / (stats->count - 1);
+}
+
+void free_scanned_device(ScannedDevice *node){
+
+    remove_list_node(&node->lru_list_entry);
+
+    if(NULL != node->payloads){
+        mp_free(&payload_mempool, node->payloads);
+        node->payloads = NULL;
+    }
+
+    mp_free(&mempool, node);
+}
+
+/* A static function inserting the node at the tail of the input LRU list, as
+   the most recently seen node in it. */
+static inline void insert_lru_list_tail(ScannedDevice *node,
+                                        struct List_Entry *lru_list_head){
+
+    insert_list_tail(&node->lru_list_entry, lru_list_head);
+    node->lru_list_head = lru_list_head;
+}
+
+/* A static function returning the payloads of a node, which are allocated
+   the first time a rule needs them. It returns NULL if the memory pool is 
+   exhausted. */
+static ScannedPayload *get_scanned_payload(ScannedDevice *node){
+
+    if(NULL == node->payloads){
+
+        node->payloads = (ScannedPayload *) mp_alloc(&payload_mempool);
+
+        if(NULL == node->payloads){
+            zlog_error(category_debug,
+                       "Unable to get memory for payloads of %012llX",
+                       (unsigned long long) node->mac_key);
+            return NULL;
+        }
+
+        node->payloads->payload_length = 0;
+        node->payloads->scan_rsp_length = 0;
+    }
+
+    return node->payloads;
+}
+
+void send_to_push_dongle(uint64_t mac_key,
                          DeviceType device_type,
-                         int rssi,
+                         RssiStats *rssi_stats,
                          int is_button_pressed,
                          int battery_voltage,
                          bool is_payload_needed,
                          bool is_scan_rsp_needed,
                          uint8_t *payload,
-                         size_t payload_length) {
+                         size_t payload_length,
+                         unsigned long long read_time_in_us) {
 
     struct ScannedDevice *temp_node;
+    ScannedPayload *payloads;
+    ObjectListHead *list;
+    ObjectListHead *object_list;
+    unsigned int generation;
+    unsigned int shard_index = get_device_shard_index(mac_key);
+    DeviceShard *shard = &device_shards[shard_index];
+    int scanned_time;
 
     /* Check whether the MAC address has been seen recently by the LBeacon.*/
     switch(device_type){
         case BLE:
-            temp_node = check_is_in_list(mac_address, &BLE_object_list_head);
+            list = &BLE_object_list_head;
+            object_list = &BLE_object_list_head;
             break;
         case BR_EDR:
             /* BR_EDR devices including BR_EDR phone (feature phone):
             scanned_list should have distinct nodes. So we use scanned_list_head
             for checking the existance of MAC address here.
             */
-            temp_node = check_is_in_list(mac_address, &scanned_list_head);
+            list = &scanned_list_head;
+            object_list = &BR_object_list_head;
             break;
         default:
             zlog_error(category_debug, "Unknown device_type=[%d]",
@@ -467,28 +842,59 @@ void send_to_push_dongle(char * mac_address,
             return;
     }
 
+    /* A pressed button is pushed to the gateway right away, instead of 
+    waiting for the next poll of the tracked object data */
+    if(1 == is_button_pressed && g_config.panic_alert_enabled){
+        raise_panic_alert(mac_key, rssi_stats->max, battery_voltage, 
+                          read_time_in_us);
+    }
+
+    /* The time the report is read, in the system time. The report may wait
+    in the coalescing cache and the queue of this thread for a while. 
+    read_time_in_us is a monotonic time, so that only its age is used. */
+    scanned_time = get_system_time() - 
+                   (int) ((get_clock_time_in_us() - read_time_in_us) / 
+                          1000000);
+
+    /* Hold the lock of the shard while updating the node, so that the node
+    cannot be released by consolidate_tracked_data() or cleanup_lists() 
+    meanwhile. Devices in other shards are not blocked. */
+    pthread_mutex_lock(&shard->lock);
+
+    temp_node = check_is_in_list(mac_key, list);
+
     if(NULL != temp_node){
         /* Update the final scan time */
-        temp_node->final_scanned_time = get_system_time();
+        temp_node->final_scanned_time = scanned_time;
+
+        /* Move the node to the tail of the LRU list as the most recently
+        seen, unless it is being reported */
+        if(!is_isolated_node(&temp_node->lru_list_entry)){
+            remove_list_node(&temp_node->lru_list_entry);
+            insert_list_tail(&temp_node->lru_list_entry, 
+                             temp_node->lru_list_head);
+        }
         
         temp_node->is_payload_needed = is_payload_needed;
         temp_node->is_scan_rsp_needed = is_scan_rsp_needed;
         
-        if(is_payload_needed){
-            memcpy(temp_node -> payload, payload, payload_length);
-            temp_node -> payload_length = payload_length;
+        if(is_payload_needed && 
+           NULL != (payloads = get_scanned_payload(temp_node))){
+            memcpy(payloads -> payload, payload, payload_length);
+            payloads -> payload_length = payload_length;
         }
         if(is_button_pressed == 1){
             temp_node->is_button_pressed = is_button_pressed;
         }
         temp_node->battery_voltage = battery_voltage;
-        /* use the strongest singal strength */
-        if(rssi > temp_node->rssi){
-            temp_node->rssi = rssi;
-        }
+        merge_rssi_stats(&temp_node->rssi_stats, rssi_stats);
+
+        pthread_mutex_unlock(&shard->lock);
         return;
     }
 
+    pthread_mutex_unlock(&shard->lock);
+
     /* The address is new. */
 
     /* Allocate memory from memory pool for a new node, initialize the
@@ -498,8 +904,8 @@ void send_to_push_dongle(char * mac_address,
     BLE_object_list_head. */
 
     zlog_debug(category_debug,
-               "New device: device_type[%d] - %17s - RSSI %4d",
-               device_type, mac_address, rssi);
+               "New device: device_type[%d] - %012llX - RSSI %4d",
+               device_type, (unsigned long long) mac_key, rssi_stats->max);
 
     temp_node = (struct ScannedDevice*) mp_alloc(&mempool);
     if(NULL == temp_node){
@@ -515,232 +921,325 @@ void send_to_push_dongle(char * mac_address,
     /* Initialize the list entries */
     init_entry(&temp_node->sc_list_entry);
     init_entry(&temp_node->tr_list_entry);
+    init_entry(&temp_node->ht_list_entry);
+    init_entry(&temp_node->lru_list_entry);
 
     /* Get the initial scan time for the new node. */
-    temp_node->initial_scanned_time = get_system_time();
+    temp_node->initial_scanned_time = scanned_time;
     temp_node->final_scanned_time = temp_node->initial_scanned_time;
-    temp_node->rssi = rssi;
+    temp_node->rssi_stats = *rssi_stats;
     temp_node->is_button_pressed = is_button_pressed;
     temp_node->battery_voltage = battery_voltage;
-    memset(temp_node->payload, 0, sizeof(temp_node->payload));
+    temp_node->mac_key = mac_key;
+    temp_node->payloads = NULL;
     
     temp_node->is_payload_needed = is_payload_needed;
     temp_node->is_scan_rsp_needed = is_scan_rsp_needed;
-    if(is_payload_needed){
-         memcpy(temp_node -> payload, payload, payload_length);
-         temp_node -> payload_length = payload_length;
-    }
 
-    /* Copy the MAC address to the node */
-    strncpy(temp_node->scanned_mac_address, mac_address,
-            LENGTH_OF_MAC_ADDRESS);
+    /* The payloads are allocated up front if the scan response is needed,
+    so that it can be stored when it arrives. */
+    if(is_payload_needed || is_scan_rsp_needed){
+
+        payloads = get_scanned_payload(temp_node);
+
+        if(is_payload_needed && NULL != payloads){
+            memcpy(payloads -> payload, payload, payload_length);
+            payloads -> payload_length = payload_length;
+        }
+    }
 
     /* Insert the new node into the right lists. */
-    pthread_mutex_lock(&list_lock);
+    pthread_mutex_lock(&shard->lock);
+
+    /* The new node goes into the generation of the object list which is 
+    active now. consolidate_tracked_data() swaps the generations only while
+    it does not hold the lock of any shard. */
+    generation = __atomic_load_n(&object_list->active_generation,
+                                 __ATOMIC_ACQUIRE);
 
     if(BLE == device_type){
 
         /* Insert the new node at the tail of the BLE_object_list_head */
         insert_list_tail(&temp_node->tr_list_entry,
-                         &BLE_object_list_head.list_entry);
+                         &object_list->list_entries[generation][shard_index]);
+
+        /* Index the new node by its MAC address */
+        insert_device_hash_table(object_list->hash_tables[generation], 
+                                 temp_node);
 
     }else if(BR_EDR == device_type){
 
         /* Insert the new node at the tail of the scanned list */
         insert_list_first(&temp_node->sc_list_entry,
-                          &scanned_list_head.list_entry);
+                          &scanned_list_head.list_entries[0][shard_index]);
 
         /* Insert the new node at the tail of the BR_object_list_head  */
         insert_list_tail(&temp_node->tr_list_entry,
-                         &BR_object_list_head.list_entry);
+                         &object_list->list_entries[generation][shard_index]);
+
+        /* Index the new node by its MAC address */
+        insert_device_hash_table(scanned_list_head.hash_tables[0], temp_node);
     }
-    pthread_mutex_unlock(&list_lock);
+
+    insert_lru_list_tail(temp_node, 
+                         &object_list->lru_list_entries[generation]
+                                                       [shard_index]);
+
+    pthread_mutex_unlock(&shard->lock);
 
     return;
 }
 
-void send_to_push_dongle_scan_rsp(char * mac_address,
+void send_to_push_dongle_scan_rsp(uint64_t mac_key,
                                   DeviceType device_type,
                                   uint8_t *payload,
                                   size_t payload_length) {
 
     struct ScannedDevice *temp_node;
+    ScannedPayload *payloads;
+    DeviceShard *shard = &device_shards[get_device_shard_index(mac_key)];
 
     /* Check whether the MAC address has been seen recently by the LBeacon.*/
-    switch(device_type){
-        case BLE:
-            temp_node = check_is_in_list(mac_address, &BLE_object_list_head);
-            break;
-        default:
-            zlog_error(category_debug, "Unknown device_type=[%d]",
-                       device_type);
-            return;
+    if(BLE != device_type){
+        zlog_error(category_debug, "Unknown device_type=[%d]",
+                   device_type);
+        return;
     }
 
+    pthread_mutex_lock(&shard->lock);
+
+    temp_node = check_is_in_list(mac_key, &BLE_object_list_head);
+
     if(NULL != temp_node){
  
-        if(temp_node->is_scan_rsp_needed){       
-            memcpy(temp_node -> scan_rsp, payload, payload_length);
-            temp_node -> scan_rsp_length = payload_length;
+        if(temp_node->is_scan_rsp_needed &&
+           NULL != (payloads = get_scanned_payload(temp_node))){       
+            memcpy(payloads -> scan_rsp, payload, payload_length);
+            payloads -> scan_rsp_length = payload_length;
         }
     }
+
+    pthread_mutex_unlock(&shard->lock);
+
     return;
 }
 
-int compare_mac_address(char address[],
-                        ScannedDevice *node,
-                        int number_digits_compared){
-    int ret_val;
+uint64_t convert_mac_address_to_key(char *mac_address){
 
-    /* Compare the first NUMBER_DIGITS_TO_COMPARE characters
-    and only compare the whole MAC address if it matches
-    the first part.
-    */
+    uint64_t mac_key = 0;
+    int i;
+
+    for(i = 0 ; i < LENGTH_OF_MAC_ADDRESS && '\0' != mac_address[i] ; i++){
+
+        /* Skip the ':' separators between bytes */
+        if(isxdigit(mac_address[i])){
+            mac_key = (mac_key << 4) | 
+                      hex_to_decimal(toupper(mac_address[i]));
+        }
+    }
+
+    return mac_key;
+}
 
-    ret_val = strncmp(address, node->scanned_mac_address,
-                      number_digits_compared);
+uint64_t convert_bdaddr_to_key(bdaddr_t *bdaddr){
 
-    if(0 != ret_val)
-        return ret_val;
+    uint64_t mac_key = 0;
+    int i;
 
-    ret_val = strncmp(address, node->scanned_mac_address,
-                      strlen(address));
+    /* bdaddr_t stores the least significant byte first, while the string 
+    format of a MAC address starts from the most significant byte. */
+    for(i = sizeof(bdaddr->b) - 1 ; i >= 0 ; i--){
+        mac_key = (mac_key << 8) | bdaddr->b[i];
+    }
 
-    return ret_val;
+    return mac_key;
 }
 
-int convert_str_to_mac_address(char mac_address_payload[],
-                               char *out_buf){
-                                   
-    const int len_of_mac_address = 12;
-    int i = 0;
-    int index = 0;
-    
-    for(i = 0 ; i < len_of_mac_address ; i++, index++){
-        *(out_buf + index) = mac_address_payload[i];
-        if(i % 2 == 1 && i != len_of_mac_address - 1){
-            index++;
-            *(out_buf + index) = ':';
+void convert_key_to_mac_address(uint64_t mac_key, char *out_buf){
+
+    snprintf(out_buf, LENGTH_OF_MAC_ADDRESS, 
+             "%02X:%02X:%02X:%02X:%02X:%02X",
+             (unsigned int)((mac_key >> 40) & 0xFF),
+             (unsigned int)((mac_key >> 32) & 0xFF),
+             (unsigned int)((mac_key >> 24) & 0xFF),
+             (unsigned int)((mac_key >> 16) & 0xFF),
+             (unsigned int)((mac_key >> 8) & 0xFF),
+             (unsigned int)(mac_key & 0xFF));
+}
+
+ErrorCode convert_hex_to_prefix(char *hex_str, HexPrefix *prefix){
+
+    size_t i;
+    size_t length = strlen(hex_str);
+
+    if(length > sizeof(prefix->bytes) * 2)
+        return E_CONFIG_SETTING;
+
+    memset(prefix->bytes, 0, sizeof(prefix->bytes));
+
+    for(i = 0 ; i < length ; i++){
+
+        if(!isxdigit(hex_str[i]))
+            return E_CONFIG_SETTING;
+
+        if(i % 2 == 0){
+            prefix->bytes[i / 2] = 
+                hex_to_decimal(toupper(hex_str[i])) << 4;
+        }else{
+            prefix->bytes[i / 2] |= hex_to_decimal(toupper(hex_str[i]));
         }
     }
-    *(out_buf + index) = '\0';
-        
-    return 0;                                   
+
+    prefix->number_digits = length;
+
+    return WORK_SUCCESSFULLY;
 }
 
-struct ScannedDevice *check_is_in_list(char address[],
-                                       ObjectListHead *list) {
+/* A static function returning the index of the bucket of the hash tables
+   into which the input MAC address key falls. */
+static inline unsigned int get_device_hash_index(uint64_t mac_key){
 
-    struct List_Entry *list_pointer, *save_list_pointers;
-    ScannedDevice *temp = NULL;
-    bool temp_is_null = true;
-    bool is_empty = false;
-    bool is_to_remove_from_scanned_list = false;
+    return ((mac_key * DEVICE_HASH_MULTIPLIER) >> 32) & 
+           (NUMBER_BUCKETS_IN_DEVICE_HASH_TABLE - 1);
+}
 
-    /* If there is no node in the list, return NULL directly. */
-    pthread_mutex_lock(&list_lock);
+/* A static function returning the bucket of the hash table into which the 
+   input MAC address key falls. */
+static inline struct List_Entry *get_device_hash_bucket(DeviceHashTable *table,
+                                                        uint64_t mac_key){
 
-    is_empty = is_entry_list_empty(&list->list_entry);
+    return &table->buckets[get_device_hash_index(mac_key)];
+}
 
-    pthread_mutex_unlock(&list_lock);
+unsigned int get_device_shard_index(uint64_t mac_key){
 
-    if(is_empty){
-        return NULL;
+    /* Each bucket belongs to one shard, so that the lock of the shard also
+    protects the bucket. */
+    return get_device_hash_index(mac_key) & (NUMBER_DEVICE_SHARDS - 1);
+}
+
+bool is_object_list_empty(ObjectListHead *list){
+
+    bool is_empty = true;
+    int i, generation;
+
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS && is_empty ; i++){
+
+        pthread_mutex_lock(&device_shards[i].lock);
+
+        for(generation = 0 ; generation < NUMBER_GENERATIONS ; generation++){
+            is_empty = is_empty && 
+                       is_entry_list_empty(
+                           &list->list_entries[generation][i]);
+        }
+
+        pthread_mutex_unlock(&device_shards[i].lock);
     }
 
-    /* Go through the list to check whether the input address is in
-    the list.
-    */
-    switch(list->device_type){
-        case BR_EDR:
-            pthread_mutex_lock(&list_lock);
+    return is_empty;
+}
 
-            list_for_each_safe(list_pointer, save_list_pointers,
-                               &list->list_entry) {
+void init_device_hash_table(DeviceHashTable *table){
 
-                /* BR_EDR device, e.g a BR_EDR phone (feature phone):
-                Use scanned_list_head for checking the existance of MAC
-                address here.
-                */
-                temp = ListEntry(list_pointer, ScannedDevice,
-                                 sc_list_entry);
+    int i;
 
-                if(true == is_to_remove_from_scanned_list){
+    for(i = 0 ; i < NUMBER_BUCKETS_IN_DEVICE_HASH_TABLE ; i++){
+        init_entry(&table->buckets[i]);
+    }
+}
 
-                    /* The node has been in the scanned list for more than
-                    INTERVAL_FOR_CLEANUP_SCANNED_LIST_IN_SEC seconds. Remove
-                    it from the scanned list directly.
-                    */
-                    remove_list_node(&temp->sc_list_entry);
+ScannedDevice *lookup_device_hash_table(DeviceHashTable *table,
+                                        uint64_t mac_key){
 
-                    /* If the node no longer is in the BR_object_list_head,
-                    free the space back to the memory pool.
-                    */
-                    if(is_isolated_node(&temp->tr_list_entry)){
-                        zlog_debug(category_debug,
-                                   "Remove scanned list [%s] from "
-                                   "scanned_list_head",
-                                   temp->scanned_mac_address);
-                        mp_free(&mempool, temp);
-                    }
+    struct List_Entry *bucket, *list_pointer;
+    ScannedDevice *temp;
 
-                }else if (get_system_time() - temp->initial_scanned_time >
-                          INTERVAL_FOR_CLEANUP_SCANNED_LIST_IN_SEC){
-                    /* If the device has been in the scanned list for at
-                    least INTERVAL_FOR_CLEANUP_SCANNED_LIST_IN_SEC seconds,
-                    remove its struct node from the scanned list here.
-                    All remaining entries in the scanned list have all
-                    been there for more than
-                    INTERVAL_FOR_CLEANUP_SCANNED_LIST_IN_SEC seconds.
-                    Set the flag is_to_remove_from_scanned_list to true
-                    */
-                    is_to_remove_from_scanned_list = true;
-                    remove_list_node(&temp->sc_list_entry);
+    bucket = get_device_hash_bucket(table, mac_key);
 
-                    /* If the node no longer is in the BR object list, free
-                    the space back to the memory pool.
-                    */
-                    if(is_isolated_node(&temp->tr_list_entry)){
-                        zlog_debug(category_debug,
-                                   "Remove scanned list [%17s] "
-                                   "from scanned_list_head",
-                                   temp->scanned_mac_address);
-                        mp_free(&mempool, temp);
-                    }
+    list_for_each(list_pointer, bucket){
 
-                }else if (0 == compare_mac_address(address, temp,
-                                                   NUMBER_DIGITS_TO_COMPARE) &&
-                          0 == compare_mac_address(address, temp,
-                                                   LENGTH_OF_MAC_ADDRESS)){
-                    temp_is_null = false;
-                    break;
-                }
-            } // list for each safe
+        temp = ListEntry(list_pointer, ScannedDevice, ht_list_entry);
+
+        if(temp->mac_key == mac_key){
+            return temp;
+        }
+    }
 
-            pthread_mutex_unlock(&list_lock);
+    return NULL;
+}
 
-            break;
+void insert_device_hash_table(DeviceHashTable *table, ScannedDevice *node){
 
-        case BLE:
+    insert_list_first(&node->ht_list_entry, 
+                      get_device_hash_bucket(table, node->mac_key));
+}
 
-            pthread_mutex_lock(&list_lock);
+void remove_device_hash_table(ScannedDevice *node){
 
-            list_for_each_safe(list_pointer, save_list_pointers,
-                               &list->list_entry) {
+    remove_list_node(&node->ht_list_entry);
+}
+
+struct ScannedDevice *check_is_in_list(uint64_t mac_key,
+                                       ObjectListHead *list) {
+
+    struct List_Entry *list_pointer, *save_list_pointers;
+    ScannedDevice *temp = NULL;
+    int current_time;
+    unsigned int generation = 
+        __atomic_load_n(&list->active_generation, __ATOMIC_ACQUIRE);
+
+    if(NULL == list->hash_tables[generation]){
+        zlog_error(category_debug,
+                   "The list of device type=[%d] is not indexed by MAC "
+                   "address", list->device_type);
+        return NULL;
+    }
+
+    switch(list->device_type){
+        case BR_EDR:
+
+            /* BR_EDR device, e.g a BR_EDR phone (feature phone):
+            Use scanned_list_head for checking the existance of MAC
+            address here. New nodes are inserted at the head of the scanned
+            list, so the nodes which have been in the scanned list for more
+            than INTERVAL_FOR_CLEANUP_SCANNED_LIST_IN_SEC seconds are all at
+            the tail of the list. Remove them from the part of the scanned 
+            list in the shard of the input address and the hash table before
+            looking up the input address.
+            */
+            current_time = get_system_time();
+
+            list_for_each_safe_reverse(
+                list_pointer, save_list_pointers,
+                &list->list_entries[generation]
+                                   [get_device_shard_index(mac_key)]) {
 
                 temp = ListEntry(list_pointer, ScannedDevice,
-                                 tr_list_entry);
+                                 sc_list_entry);
 
-                if (0 == compare_mac_address(address, temp,
-                                             NUMBER_DIGITS_TO_COMPARE) &&
-                    0 == compare_mac_address(address, temp,
-                                             LENGTH_OF_MAC_ADDRESS)){
-                    temp_is_null = false;
+                if(current_time - temp->initial_scanned_time <=
+                   INTERVAL_FOR_CLEANUP_SCANNED_LIST_IN_SEC){
                     break;
                 }
+
+                remove_list_node(&temp->sc_list_entry);
+                remove_device_hash_table(temp);
+
+                /* If the node no longer is in the BR object list, free
+                the space back to the memory pool.
+                */
+                if(is_isolated_node(&temp->tr_list_entry)){
+                    zlog_debug(category_debug,
+                               "Remove scanned list [%012llX] "
+                               "from scanned_list_head",
+                               (unsigned long long) temp->mac_key);
+                    free_scanned_device(temp);
+                }
             }
 
-            pthread_mutex_unlock(&list_lock);
+            break;
+
+        case BLE:
 
             break;
 
@@ -752,18 +1251,371 @@ struct ScannedDevice *check_is_in_list(char address[],
             zlog_error(category_debug,
                        "Unknown device type=[%d]",
                        list->device_type);
-            break;
+            return NULL;
     }  // end of switch
 
-    if(true == temp_is_null){
-        return NULL;
-    }
-
-    return temp;
+    /* Nodes in the frozen generation of the list are being reported, and 
+    are not found here. */
+    return lookup_device_hash_table(list->hash_tables[generation], mac_key);
 }
 
-ErrorCode enable_advertising(int dongle_device_id,
-                             int advertising_interval_in_units_0625_ms,
+ErrorCode open_hci_transport(HCI_Transport *transport,
+                             int dongle_device_id,
+                             uint8_t synthetic_event){
+    int retry_times = 0;
+    int ret = HCI_TRANSPORT_ERROR;
+
+    switch(g_config.scan_hci_transport){
+        case HCI_TRANSPORT_SOCKET:
+
+            retry_times = SOCKET_OPEN_RETRY;
+            while(retry_times--){
+                ret = ht_open_socket(transport, dongle_device_id);
+
+                if(HCI_TRANSPORT_SUCCESS == ret){
+                    break;
+                }
+            }
+            break;
+
+        case HCI_TRANSPORT_REPLAY:
+
+            ret = ht_open_replay(transport, g_config.scan_hci_replay_file);
+            break;
+
+        case HCI_TRANSPORT_SYNTHETIC:
+
+            ret = ht_open_synthetic(transport,
+                                    synthetic_event,
+                                    g_config.scan_synthetic_number_tags,
+                                    g_config.scan_synthetic_adverts_per_second);
+            break;
+
+        default:
+            break;
+    }
+
+    if(HCI_TRANSPORT_SUCCESS != ret){
+        zlog_error(category_health_report,
+                   "Error openning HCI transport=[%d]", 
+                   g_config.scan_hci_transport);
+        zlog_error(category_debug,
+                   "Error openning HCI transport=[%d]", 
+                   g_config.scan_hci_transport);
+        return E_OPEN_SOCKET;
+    }
+
+    return WORK_SUCCESSFULLY;
+}
+
+static unsigned int find_known_tag_slot(uint64_t mac_key){
+    unsigned int slot;
+
+    slot = (mac_key * DEVICE_HASH_MULTIPLIER) >> 
+           (64 - __builtin_ctz(SLOTS_IN_KNOWN_TAG_TABLE));
+
+    /* The table is never more than half full, so an empty slot ends the 
+    probing. */
+    while(0 != known_tag_table.mac_key[slot] &&
+          mac_key != known_tag_table.mac_key[slot]){
+        slot = (slot + 1) & (SLOTS_IN_KNOWN_TAG_TABLE - 1);
+    }
+
+    return slot;
+}
+
+void learn_known_tag(uint64_t mac_key, uint8_t bdaddr_type, 
+                     bool is_configured){
+    unsigned int slot;
+
+    pthread_mutex_lock(&known_tag_table.lock);
+
+    slot = find_known_tag_slot(mac_key);
+
+    if(0 == known_tag_table.mac_key[slot]){
+
+        if(known_tag_table.number_tags >= MAX_NUMBER_KNOWN_TAGS){
+            known_tag_table.is_overflowed = true;
+            pthread_mutex_unlock(&known_tag_table.lock);
+            return;
+        }
+
+        known_tag_table.mac_key[slot] = mac_key;
+        known_tag_table.is_configured[slot] = is_configured;
+        known_tag_table.number_tags++;
+    }
+
+    known_tag_table.bdaddr_type[slot] = bdaddr_type;
+    known_tag_table.last_seen_time[slot] = get_system_time();
+
+    pthread_mutex_unlock(&known_tag_table.lock);
+}
+
+int get_known_tags(uint64_t *mac_keys, 
+                   uint8_t *bdaddr_types, 
+                   bool *is_overflowed){
+    bool is_configured[MAX_NUMBER_KNOWN_TAGS];
+    int last_seen_time[MAX_NUMBER_KNOWN_TAGS];
+    int current_time = get_system_time();
+    int number_tags = 0;
+    unsigned int slot;
+    int i;
+
+    pthread_mutex_lock(&known_tag_table.lock);
+
+    for(slot = 0 ; slot < SLOTS_IN_KNOWN_TAG_TABLE ; slot++){
+
+        if(0 == known_tag_table.mac_key[slot])
+            continue;
+
+        if(known_tag_table.is_configured[slot] ||
+           current_time - known_tag_table.last_seen_time[slot] <
+           KNOWN_TAG_TIMEOUT_IN_SEC){
+
+            mac_keys[number_tags] = known_tag_table.mac_key[slot];
+            bdaddr_types[number_tags] = known_tag_table.bdaddr_type[slot];
+            is_configured[number_tags] = known_tag_table.is_configured[slot];
+            last_seen_time[number_tags] = 
+                known_tag_table.last_seen_time[slot];
+            number_tags++;
+        }
+    }
+
+    /* Rebuild the table from the tags not timed out, since a slot in the
+    middle of a probe sequence cannot simply be emptied. */
+    memset(known_tag_table.mac_key, 0, sizeof(known_tag_table.mac_key));
+
+    for(i = 0 ; i < number_tags ; i++){
+
+        slot = find_known_tag_slot(mac_keys[i]);
+
+        known_tag_table.mac_key[slot] = mac_keys[i];
+        known_tag_table.bdaddr_type[slot] = bdaddr_types[i];
+        known_tag_table.is_configured[slot] = is_configured[i];
+        known_tag_table.last_seen_time[slot] = last_seen_time[i];
+    }
+
+    known_tag_table.number_tags = number_tags;
+
+    *is_overflowed = known_tag_table.is_overflowed;
+    known_tag_table.is_overflowed = false;
+
+    pthread_mutex_unlock(&known_tag_table.lock);
+
+    return number_tags;
+}
+
+/* A static function returning the slot of the input MAC address in the table
+   of the last reported states, or the empty slot the address would go to. */
+static unsigned int find_reported_state_slot(ReportedStateTable *table,
+                                             uint64_t mac_key){
+    unsigned int slot;
+
+    slot = (mac_key * DEVICE_HASH_MULTIPLIER) >> 
+           (64 - __builtin_ctz(SLOTS_IN_REPORTED_STATE_TABLE));
+
+    /* The table is never more than half full, so an empty slot ends the 
+    probing. */
+    while(0 != table->mac_key[slot] && mac_key != table->mac_key[slot]){
+        slot = (slot + 1) & (SLOTS_IN_REPORTED_STATE_TABLE - 1);
+    }
+
+    return slot;
+}
+
+bool is_report_needed(ReportedStateTable *table, 
+                      ScannedDevice *node, 
+                      int current_time){
+    unsigned int slot;
+    int rssi_band;
+
+    /* Shift the RSSI value to be positive, so that the bands do not depend
+    on the rounding of negative numbers. */
+    rssi_band = (node->rssi_stats.max + 128) / g_config.delta_rssi_band_in_db;
+
+    slot = find_reported_state_slot(table, node->mac_key);
+
+    if(0 == table->mac_key[slot]){
+
+        /* The device has no state to compare with if the table is full */
+        if(table->number_devices >= MAX_NUMBER_REPORTED_DEVICES)
+            return true;
+
+        table->mac_key[slot] = node->mac_key;
+        table->number_devices++;
+
+    }else if(rssi_band == table->rssi_band[slot] &&
+             node->is_button_pressed == table->is_button_pressed[slot] &&
+             node->battery_voltage == table->battery_voltage[slot] &&
+             current_time - table->last_reported_time[slot] <
+             g_config.delta_heartbeat_interval_in_sec){
+
+        table->last_seen_time[slot] = node->final_scanned_time;
+        return false;
+    }
+
+    table->last_seen_time[slot] = node->final_scanned_time;
+    table->last_reported_time[slot] = current_time;
+    table->rssi_band[slot] = rssi_band;
+    table->is_button_pressed[slot] = node->is_button_pressed;
+    table->battery_voltage[slot] = node->battery_voltage;
+
+    return true;
+}
+
+int get_left_devices(ReportedStateTable *table, 
+                     int current_time,
+                     uint64_t *mac_keys, 
+                     int max_number_devices){
+    int number_devices = 0;
+    unsigned int slot, next_slot, home_slot;
+    int i;
+
+    for(slot = 0 ; slot < SLOTS_IN_REPORTED_STATE_TABLE && 
+                   number_devices < max_number_devices ; slot++){
+
+        if(0 != table->mac_key[slot] &&
+           current_time - table->last_seen_time[slot] >= 
+           g_config.delta_left_timeout_in_sec){
+
+            mac_keys[number_devices++] = table->mac_key[slot];
+        }
+    }
+
+    /* Remove the devices found above. The entries following a removed one 
+    in its probe sequence are shifted back into the hole, unless they are 
+    already at or after their home slot, since a slot in the middle of a 
+    probe sequence cannot simply be emptied. */
+    for(i = 0 ; i < number_devices ; i++){
+
+        slot = find_reported_state_slot(table, mac_keys[i]);
+        table->mac_key[slot] = 0;
+        table->number_devices--;
+
+        next_slot = (slot + 1) & (SLOTS_IN_REPORTED_STATE_TABLE - 1);
+
+        while(0 != table->mac_key[next_slot]){
+
+            home_slot = (table->mac_key[next_slot] * DEVICE_HASH_MULTIPLIER) >>
+                        (64 - __builtin_ctz(SLOTS_IN_REPORTED_STATE_TABLE));
+
+            if(((next_slot - home_slot) & 
+                (SLOTS_IN_REPORTED_STATE_TABLE - 1)) >=
+               ((next_slot - slot) & (SLOTS_IN_REPORTED_STATE_TABLE - 1))){
+
+                table->mac_key[slot] = table->mac_key[next_slot];
+                table->last_seen_time[slot] = 
+                    table->last_seen_time[next_slot];
+                table->last_reported_time[slot] = 
+                    table->last_reported_time[next_slot];
+                table->rssi_band[slot] = table->rssi_band[next_slot];
+                table->is_button_pressed[slot] = 
+                    table->is_button_pressed[next_slot];
+                table->battery_voltage[slot] = 
+                    table->battery_voltage[next_slot];
+
+                table->mac_key[next_slot] = 0;
+                slot = next_slot;
+            }
+
+            next_slot = (next_slot + 1) & (SLOTS_IN_REPORTED_STATE_TABLE - 1);
+        }
+    }
+
+    return number_devices;
+}
+
+ErrorCode set_ble_scanning(int socket,
+                           int scan_type,
+                           int accept_list_size,
+                           bool is_discovery){
+    uint64_t mac_keys[MAX_NUMBER_KNOWN_TAGS];
+    uint8_t bdaddr_types[MAX_NUMBER_KNOWN_TAGS];
+    bdaddr_t bdaddr;
+    bool is_overflowed = false;
+    int number_tags = 0;
+    int own_type = 0x00;
+    int filter_policy = 0x00; // 0x00: accept all, 0x01: accept list only
+    int i;
+    size_t j;
+
+    /* The parameters and the accept list cannot be changed while 
+    scanning. Disabling a disabled scanning fails harmlessly. */
+    hci_le_set_scan_enable(socket, 0x00, 0, HCI_SEND_REQUEST_TIMEOUT_IN_MS);
+
+    if(g_config.scan_accept_list_enabled && !is_discovery){
+
+        number_tags = get_known_tags(mac_keys, bdaddr_types, &is_overflowed);
+
+        if(0 < number_tags && number_tags <= accept_list_size && 
+           !is_overflowed &&
+           0 <= hci_le_clear_white_list(socket, 
+                                        HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+
+            filter_policy = 0x01;
+
+            for(i = 0 ; i < number_tags ; i++){
+
+                for(j = 0 ; j < sizeof(bdaddr_t) ; j++){
+                    bdaddr.b[j] = (mac_keys[i] >> (8 * j)) & 0xFF;
+                }
+
+                if(0 > hci_le_add_white_list(socket, 
+                                             &bdaddr, 
+                                             bdaddr_types[i],
+                                             HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+                    filter_policy = 0x00;
+                    break;
+                }
+            }
+        }
+
+        if(0x00 == filter_policy){
+            zlog_info(category_debug,
+                      "Accept list not used: tags=[%d], size=[%d], "
+                      "overflowed=[%d]",
+                      number_tags, accept_list_size, is_overflowed);
+        }
+    }
+
+    if( 0> hci_le_set_scan_parameters(socket, 
+                                      scan_type, 
+                                      htobs((uint16_t)g_config.scan_interval_in_units_0625_ms),
+                                      htobs((uint16_t)g_config.scan_window_in_units_0625_ms),
+                                      own_type,
+                                      filter_policy,
+                                      HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+
+        zlog_info(category_health_report,
+                  "Error setting parameters of BLE scanning");
+        zlog_debug(category_debug,
+                  "Error setting parameters of BLE scanning");
+    }
+
+    if( 0> hci_le_set_scan_enable(socket, 
+                                  0x01, 
+                                  g_config.scan_duplicate_filter_enabled ? 
+                                  0x01 : 0x00,
+                                  HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+
+        zlog_info(category_health_report,
+                  "Error enabling BLE scanning");
+        zlog_debug(category_debug,
+                   "Error enabling BLE scanning");
+        return E_SCAN_SET_ENABLE;
+    }
+
+    zlog_debug(category_debug,
+               "BLE scanning armed: filter_policy=[%d], tags=[%d], "
+               "duplicate_filter=[%d]",
+               filter_policy, number_tags, 
+               g_config.scan_duplicate_filter_enabled);
+
+    return WORK_SUCCESSFULLY;
+}
+
+ErrorCode enable_advertising(int dongle_device_id,
+                             int advertising_interval_in_units_0625_ms,
                              char *advertising_uuid,
                              int major_number,
                              int minor_number,
@@ -1130,8 +1982,11 @@ ErrorCode beacon_basic_info(char *message, size_t message_size, int poll_type){
     char timestamp[LENGTH_OF_EPOCH_TIME];
 
     // The beginning information is pkt_direction;pkt_type;GATEWAY_API_version;
+    // The devices which left are only reported in the delta reporting mode
     snprintf(message, message_size, "%d;%d;%s;", 
-             from_beacon, poll_type, BOT_GATEWAY_API_VERSION_LATEST);
+             from_beacon, poll_type, 
+             g_config.delta_reporting_enabled ? 
+             BOT_GATEWAY_API_VERSION_LATEST : BOT_GATEWAY_API_VERSION_14);
 
     // LBeacon UUID
     strcat(message, g_config.uuid);
@@ -1235,16 +2090,14 @@ ErrorCode handle_tracked_object_data(){
     
     /* return directly, if both BR and BLE tracked lists are emtpy
     */
-    pthread_mutex_lock(&list_lock);
-
-    is_br_object_list_empty =
-        is_entry_list_empty(&BR_object_list_head.list_entry);
-    is_ble_object_list_empty =
-        is_entry_list_empty(&BLE_object_list_head.list_entry);
-
-    pthread_mutex_unlock(&list_lock);
-
-    if(is_br_object_list_empty && is_ble_object_list_empty){
+    is_br_object_list_empty = is_object_list_empty(&BR_object_list_head);
+    is_ble_object_list_empty = is_object_list_empty(&BLE_object_list_head);
+
+    /* In the delta reporting mode, the devices which left are reported 
+    even if no device is tracked now. */
+    if(is_br_object_list_empty && is_ble_object_list_empty &&
+       (NULL == BLE_object_list_head.reported_states ||
+        0 == BLE_object_list_head.reported_states->number_devices)){
         zlog_debug(category_debug, "Both BR and BLE lists are empty.");
         return WORK_SUCCESSFULLY;
     }
@@ -1318,6 +2171,52 @@ ErrorCode handle_tracked_object_data(){
     return WORK_SUCCESSFULLY;
 }
 
+/* A static function logging the statistics of a memory pool with the rates
+   since they were last reported, and warning of the failed allocations. */
+static void report_mempool_stats(char *name, 
+                                 Memory_Pool *mp, 
+                                 Memory_Pool_Stats *reported_stats,
+                                 int elapsed_time){
+
+    Memory_Pool_Stats stats;
+
+    mp_get_stats(mp, &stats);
+
+    elapsed_time = max(1, elapsed_time);
+
+    zlog_info(category_health_report,
+              "%s: slot_size=[%zu], used=[%d], peak_used=[%d], free=[%d], "
+              "slabs=[%d/%d], slots_per_expansion=[%d], "
+              "slab_releases=[%lu], "
+              "allocs_per_sec=[%.1f], frees_per_sec=[%.1f], "
+              "alloc_failures=[%lu], lock_contentions=[%lu], "
+              "lock_wait=[%llu] us, poison_errors=[%d]",
+              name, stats.size, stats.used_slots, stats.peak_used_slots,
+              stats.free_slots, stats.number_slabs, MAX_EXP_TIME,
+              stats.slots_per_expansion, stats.number_slab_releases,
+              (double) (stats.number_allocs - reported_stats->number_allocs) /
+              elapsed_time,
+              (double) (stats.number_frees - reported_stats->number_frees) /
+              elapsed_time,
+              stats.number_alloc_failures, stats.number_lock_contentions,
+              stats.lock_wait_time_in_ns / 1000, 
+              stats.number_poison_errors);
+
+    if(stats.number_alloc_failures > reported_stats->number_alloc_failures){
+
+        zlog_warn(category_health_report,
+                  "%s failed [%lu] allocations since last health report, "
+                  "peak_used=[%d], slabs=[%d/%d]",
+                  name,
+                  stats.number_alloc_failures - 
+                  reported_stats->number_alloc_failures,
+                  stats.peak_used_slots, stats.number_slabs,
+                  MAX_EXP_TIME);
+    }
+
+    *reported_stats = stats;
+}
+
 ErrorCode handle_health_report(){
     char message[WIFI_MESSAGE_LENGTH];
     FILE *self_check_file = NULL;
@@ -1328,6 +2227,128 @@ ErrorCode handle_health_report(){
     int ret_val = 0;
     char message_temp[WIFI_MESSAGE_LENGTH];
     bool is_get_file_content = false;
+    SPSC_Queue_Stats queue_stats;
+    unsigned long number_events;
+    unsigned long number_reports;
+    int current_time;
+    int i;
+
+    // log the statistics of the queues of scanned BLE devices
+    for(i = 0 ; i < g_config.number_examine_workers ; i++){
+
+        spsc_get_stats(&temp_ble_device_queues[i], &queue_stats);
+
+        zlog_info(category_health_report,
+                  "temp_ble_device_queues[%d]: capacity=[%u], length=[%u], "
+                  "high_watermark=[%u], overflow_count=[%lu]",
+                  i, queue_stats.capacity, queue_stats.length,
+                  queue_stats.high_watermark, queue_stats.overflow_count);
+
+        if(queue_stats.overflow_count > 
+           reported_temp_ble_device_queue_overflow_counts[i]){
+
+            zlog_warn(category_health_report,
+                      "temp_ble_device_queues[%d] dropped [%lu] scanned BLE "
+                      "devices since last health report, "
+                      "high_watermark=[%u]",
+                      i,
+                      queue_stats.overflow_count - 
+                      reported_temp_ble_device_queue_overflow_counts[i],
+                      queue_stats.high_watermark);
+
+            reported_temp_ble_device_queue_overflow_counts[i] = 
+                queue_stats.overflow_count;
+        }
+    }
+
+    // log the statistics of the LE advertising report events
+    number_events = __atomic_load_n(&le_advertising_stats.number_events,
+                                    __ATOMIC_RELAXED);
+    number_reports = __atomic_load_n(&le_advertising_stats.number_reports,
+                                     __ATOMIC_RELAXED);
+
+    zlog_info(category_health_report,
+              "LE advertising events=[%lu], reports=[%lu], "
+              "reports_per_event=[%.2f], max_reports_per_event=[%u], "
+              "malformed_events=[%lu]",
+              number_events, number_reports,
+              (number_events == 0) ? 0.0 : 
+              (double) number_reports / number_events,
+              __atomic_load_n(&le_advertising_stats.max_reports_per_event,
+                              __ATOMIC_RELAXED),
+              __atomic_load_n(&le_advertising_stats.number_malformed_events,
+                              __ATOMIC_RELAXED));
+
+    // log the statistics of the negative caches of the examining threads
+    for(i = 0 ; i < g_config.number_examine_workers ; i++){
+
+        zlog_info(category_health_report,
+                  "negative_caches[%d]: hits=[%lu], misses=[%lu]",
+                  i,
+                  __atomic_load_n(&negative_caches[i].number_hits,
+                                  __ATOMIC_RELAXED),
+                  __atomic_load_n(&negative_caches[i].number_misses,
+                                  __ATOMIC_RELAXED));
+    }
+
+    if(g_config.scan_coalescing_enabled){
+        zlog_info(category_health_report,
+                  "LE advertising reports coalesced=[%lu]",
+                  __atomic_load_n(
+                      &le_advertising_stats.number_coalesced_reports,
+                      __ATOMIC_RELAXED));
+    }
+
+    zlog_info(category_health_report,
+              "Evicted devices by_age=[%lu], by_pressure=[%lu], "
+              "mempool_usage=[%f], payload_mempool_usage=[%f]",
+              __atomic_load_n(&eviction_stats.number_evicted_by_age,
+                              __ATOMIC_RELAXED),
+              __atomic_load_n(&eviction_stats.number_evicted_by_pressure,
+                              __ATOMIC_RELAXED),
+              mp_slots_usage_percentage(&mempool),
+              mp_slots_usage_percentage(&payload_mempool));
+
+    // log the statistics of the memory pools
+    current_time = get_system_time();
+
+    report_mempool_stats("mempool", &mempool, &reported_mempool_stats,
+                         current_time - reported_mempool_stats_time);
+    report_mempool_stats("payload_mempool", &payload_mempool, 
+                         &reported_payload_mempool_stats,
+                         current_time - reported_mempool_stats_time);
+
+    reported_mempool_stats_time = current_time;
+
+    // log the statistics of the panic alerts
+    if(g_config.panic_alert_enabled){
+
+        pthread_mutex_lock(&panic_alert_table.lock);
+
+        zlog_info(category_health_report,
+                  "Panic alerts=[%lu], debounced=[%lu], retransmissions=[%lu],"
+                  " acked=[%lu], given_up=[%lu], dropped=[%lu]",
+                  panic_alert_table.number_alerts,
+                  panic_alert_table.number_debounced,
+                  panic_alert_table.number_retransmissions,
+                  panic_alert_table.number_acked,
+                  panic_alert_table.number_given_up,
+                  panic_alert_table.number_dropped);
+
+        /* Bucket i counts the alerts sent within 2^i ms since the HCI event
+        is read */
+        message_temp[0] = '\0';
+        for(i = 0 ; i < NUMBER_PANIC_LATENCY_BUCKETS ; i++){
+            sprintf(message_temp + strlen(message_temp), "%lu;",
+                    panic_alert_table.latency_histogram[i]);
+        }
+
+        pthread_mutex_unlock(&panic_alert_table.lock);
+
+        zlog_info(category_health_report,
+                  "Panic alert latency histogram in ms (<1;<2;<4;...)=[%s]",
+                  message_temp);
+    }
     
     // read self-check result
     is_get_file_content = false;
@@ -1445,68 +2466,301 @@ ErrorCode handle_health_report(){
     return WORK_SUCCESSFULLY;
 }
 
-ErrorCode *manage_communication(void *param){
-    int current_time;
-    int gateway_latest_time;
-    
-    JoinStatus join_status = JOIN_UNKNOWN;
-    char buf[WIFI_MESSAGE_LENGTH];
-    char *from_direction = NULL;
-    char *request_type = NULL;
-    char *API_version = NULL;
-    char *packet_content = NULL;
+void raise_panic_alert(uint64_t mac_key, 
+                       int rssi, 
+                       int battery_voltage,
+                       unsigned long long read_time_in_us){
+    PanicAlert *alert = NULL;
+    int current_time = get_system_time();
+    unsigned int sequence;
+    int i;
 
-    int pkt_direction = 0;
-    int pkt_type = 0;
-    float API_version_value = 0;
-    char *saveptr = NULL;
-    char *remain_string = NULL;
+    pthread_mutex_lock(&panic_alert_table.lock);
 
-    zlog_debug(category_debug, ">> manage_communication ");
-    
-    current_time = get_clock_time();
-    gateway_latest_time = get_clock_time();
+    for(i = 0 ; i < MAX_NUMBER_PANIC_ALERTS ; i++){
 
-    while(true == ready_to_work){
+        if(mac_key == panic_alert_table.alerts[i].mac_key){
+            alert = &panic_alert_table.alerts[i];
+            break;
+        }
 
-        sPkt tmp_pkt = udp_getrecv( &udp_config);
-            
-        if(tmp_pkt.is_null == true)
-        {
-            /* If there is no packet received, sleep a short time */
-            sleep_t(BUSY_WAITING_TIME_IN_MS);
-            continue;
+        /* An alert done and no longer debounced can be reused */
+        if(NULL == alert &&
+           (0 == panic_alert_table.alerts[i].mac_key ||
+            (panic_alert_table.alerts[i].is_done &&
+             current_time - panic_alert_table.alerts[i].last_pressed_time >=
+             g_config.panic_debounce_interval_in_sec))){
+            alert = &panic_alert_table.alerts[i];
         }
-            
-        gateway_latest_time = get_clock_time();
-        gateway_latest_polling_time = gateway_latest_time;
+    }
 
-        memset(buf, 0, sizeof(buf));
-        strcpy(buf, tmp_pkt.content); 
+    if(NULL == alert){
 
-        remain_string = buf;
-       
-        from_direction = strtok_save(buf, DELIMITER_SEMICOLON, 
-                                     &saveptr);
-        if(from_direction == NULL)
-        {
-            continue;
-        }      
-        remain_string = remain_string + strlen(from_direction) + 
-                        strlen(DELIMITER_SEMICOLON);            
-        sscanf(from_direction, "%d", &pkt_direction);
-            
-        request_type = strtok_save(NULL, DELIMITER_SEMICOLON, 
-                                   &saveptr);
-        if(request_type == NULL){
-            continue;
-        }
-        remain_string = remain_string + strlen(request_type) + 
-                        strlen(DELIMITER_SEMICOLON);
-        sscanf(request_type, "%d", &pkt_type);
-                
-        API_version = strtok_save(NULL, DELIMITER_SEMICOLON, 
-                                  &saveptr);
+        panic_alert_table.number_dropped++;
+        pthread_mutex_unlock(&panic_alert_table.lock);
+
+        zlog_error(category_health_report,
+                   "Unable to raise panic alert of %012llX",
+                   (unsigned long long) mac_key);
+        zlog_error(category_debug,
+                   "Unable to raise panic alert of %012llX",
+                   (unsigned long long) mac_key);
+        return;
+    }
+
+    /* The button of a tag stays pressed in its advertisements for a while.
+    Only the first of them raises an alert. */
+    if(mac_key == alert->mac_key &&
+       current_time - alert->last_pressed_time < 
+       g_config.panic_debounce_interval_in_sec){
+
+        alert->last_pressed_time = current_time;
+        panic_alert_table.number_debounced++;
+        pthread_mutex_unlock(&panic_alert_table.lock);
+        return;
+    }
+
+    alert->mac_key = mac_key;
+    sequence = panic_alert_table.next_sequence++;
+    alert->sequence = sequence;
+    alert->rssi = rssi;
+    alert->battery_voltage = battery_voltage;
+    alert->pressed_time = current_time;
+    alert->last_pressed_time = current_time;
+    alert->read_time_in_us = read_time_in_us;
+    alert->next_send_time_in_us = 0;
+    alert->number_sends = 0;
+    alert->is_done = false;
+
+    panic_alert_table.number_alerts++;
+
+    pthread_cond_signal(&panic_alert_table.new_alert);
+
+    pthread_mutex_unlock(&panic_alert_table.lock);
+
+    /* The slot may be reused by another examining thread once the lock is
+    released */
+    zlog_info(category_debug, "Raise panic alert [%u] of %012llX",
+              sequence, (unsigned long long) mac_key);
+}
+
+ErrorCode *send_panic_alerts(void *param){
+    char message[WIFI_MESSAGE_LENGTH];
+    char message_temp[WIFI_MESSAGE_LENGTH];
+    char mac_address[LENGTH_OF_MAC_ADDRESS];
+    PanicAlert alert;
+    PanicAlert *due_alert;
+    unsigned long long current_time_in_us;
+    unsigned long long wake_up_time_in_us;
+    unsigned long long latency_in_ms;
+    struct timespec wake_up_time;
+    int bucket;
+    int i;
+
+    zlog_debug(category_debug, ">> send_panic_alerts ");
+
+    while(true == ready_to_work){
+
+        pthread_mutex_lock(&panic_alert_table.lock);
+
+        current_time_in_us = get_clock_time_in_us();
+        wake_up_time_in_us = 
+            current_time_in_us + BUSY_WAITING_TIME_IN_MS * 1000;
+        due_alert = NULL;
+
+        for(i = 0 ; i < MAX_NUMBER_PANIC_ALERTS ; i++){
+
+            if(0 == panic_alert_table.alerts[i].mac_key ||
+               panic_alert_table.alerts[i].is_done)
+                continue;
+
+            if(panic_alert_table.alerts[i].next_send_time_in_us <= 
+               current_time_in_us){
+                due_alert = &panic_alert_table.alerts[i];
+                break;
+            }
+
+            wake_up_time_in_us = 
+                min(wake_up_time_in_us, 
+                    panic_alert_table.alerts[i].next_send_time_in_us);
+        }
+
+        if(NULL == due_alert){
+
+            /* Sleep until an alert is due or raised */
+            wake_up_time.tv_sec = wake_up_time_in_us / 1000000;
+            wake_up_time.tv_nsec = (wake_up_time_in_us % 1000000) * 1000;
+
+            pthread_cond_timedwait(&panic_alert_table.new_alert,
+                                   &panic_alert_table.lock,
+                                   &wake_up_time);
+
+            pthread_mutex_unlock(&panic_alert_table.lock);
+            continue;
+        }
+
+        /* Schedule the next send before the acknowledgement can arrive */
+        if(0 < due_alert->number_sends)
+            panic_alert_table.number_retransmissions++;
+
+        due_alert->number_sends++;
+        due_alert->next_send_time_in_us = 
+            current_time_in_us + 
+            (PANIC_ALERT_RETRANSMIT_INTERVAL_IN_MS * 1000ULL << 
+             (due_alert->number_sends - 1));
+
+        if(MAX_NUMBER_PANIC_ALERT_SENDS <= due_alert->number_sends){
+            due_alert->is_done = true;
+            panic_alert_table.number_given_up++;
+        }
+
+        alert = *due_alert;
+
+        pthread_mutex_unlock(&panic_alert_table.lock);
+
+        memset(message, 0, sizeof(message));
+
+        if(WORK_SUCCESSFULLY != 
+           beacon_basic_info(message, sizeof(message), 
+                             time_critical_tracked_object_data)){
+            continue;
+        }
+
+        convert_key_to_mac_address(alert.mac_key, mac_address);
+
+        sprintf(message_temp, "%d;%u;%s;%d;%d;%d;",
+                BLE,
+                alert.sequence,
+                mac_address,
+                alert.pressed_time,
+                alert.rssi,
+                alert.battery_voltage);
+
+        strcat(message, message_temp);
+
+        udp_sendpkt(&udp_config,
+                    g_config.gateway_addr,
+                    g_config.gateway_port,
+                    message,
+                    strlen(message));
+
+        if(1 == alert.number_sends){
+
+            latency_in_ms = 
+                (get_clock_time_in_us() - alert.read_time_in_us) / 1000;
+
+            for(bucket = 0 ; 
+                bucket < NUMBER_PANIC_LATENCY_BUCKETS - 1 && 
+                latency_in_ms >= (1ULL << bucket) ; 
+                bucket++);
+
+            pthread_mutex_lock(&panic_alert_table.lock);
+            panic_alert_table.latency_histogram[bucket]++;
+            pthread_mutex_unlock(&panic_alert_table.lock);
+        }
+
+        zlog_info(category_debug, 
+                  "Send panic alert [%u] of %s, number_sends=[%d]",
+                  alert.sequence, mac_address, alert.number_sends);
+    }
+
+    zlog_debug(category_debug, "<< send_panic_alerts ");
+
+    return WORK_SUCCESSFULLY;
+}
+
+ErrorCode handle_panic_alert_ack(char *resp_content){
+    unsigned int sequence;
+    int i;
+
+    if(1 != sscanf(resp_content, "%u", &sequence)){
+        zlog_error(category_debug, 
+                   "Invalid panic alert acknowledgement [%s]",
+                   resp_content);
+        return E_API_PROTOCOL_FORMAT;
+    }
+
+    pthread_mutex_lock(&panic_alert_table.lock);
+
+    for(i = 0 ; i < MAX_NUMBER_PANIC_ALERTS ; i++){
+
+        if(0 != panic_alert_table.alerts[i].mac_key &&
+           sequence == panic_alert_table.alerts[i].sequence &&
+           !panic_alert_table.alerts[i].is_done){
+
+            panic_alert_table.alerts[i].is_done = true;
+            panic_alert_table.number_acked++;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&panic_alert_table.lock);
+
+    return WORK_SUCCESSFULLY;
+}
+
+ErrorCode *manage_communication(void *param){
+    int current_time;
+    int gateway_latest_time;
+    
+    JoinStatus join_status = JOIN_UNKNOWN;
+    char buf[WIFI_MESSAGE_LENGTH];
+    char *from_direction = NULL;
+    char *request_type = NULL;
+    char *API_version = NULL;
+    char *packet_content = NULL;
+
+    int pkt_direction = 0;
+    int pkt_type = 0;
+    float API_version_value = 0;
+    char *saveptr = NULL;
+    char *remain_string = NULL;
+
+    zlog_debug(category_debug, ">> manage_communication ");
+    
+    current_time = get_clock_time();
+    gateway_latest_time = get_clock_time();
+
+    while(true == ready_to_work){
+
+        sPkt tmp_pkt = udp_getrecv( &udp_config);
+            
+        if(tmp_pkt.is_null == true)
+        {
+            /* If there is no packet received, sleep a short time */
+            sleep_t(BUSY_WAITING_TIME_IN_MS);
+            continue;
+        }
+            
+        gateway_latest_time = get_clock_time();
+        gateway_latest_polling_time = gateway_latest_time;
+
+        memset(buf, 0, sizeof(buf));
+        strcpy(buf, tmp_pkt.content); 
+
+        remain_string = buf;
+       
+        from_direction = strtok_save(buf, DELIMITER_SEMICOLON, 
+                                     &saveptr);
+        if(from_direction == NULL)
+        {
+            continue;
+        }      
+        remain_string = remain_string + strlen(from_direction) + 
+                        strlen(DELIMITER_SEMICOLON);            
+        sscanf(from_direction, "%d", &pkt_direction);
+            
+        request_type = strtok_save(NULL, DELIMITER_SEMICOLON, 
+                                   &saveptr);
+        if(request_type == NULL){
+            continue;
+        }
+        remain_string = remain_string + strlen(request_type) + 
+                        strlen(DELIMITER_SEMICOLON);
+        sscanf(request_type, "%d", &pkt_type);
+                
+        API_version = strtok_save(NULL, DELIMITER_SEMICOLON, 
+                                  &saveptr);
         if(API_version == NULL){
             continue;
         }
@@ -1550,6 +2804,14 @@ ErrorCode *manage_communication(void *param){
                     handle_health_report();
                     break; // health_report case
 
+                case time_critical_tracked_object_data:
+
+                    zlog_info(category_debug,
+                              "Receive panic alert acknowledgement from "
+                              "gateway");
+                    handle_panic_alert_ack(packet_content);
+                    break; // time_critical_tracked_object_data case
+
                 default:
                     zlog_warn(category_debug,
                               "Receive unknown packet type=[%d] from "
@@ -1581,9 +2843,23 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
     unsigned timestamp_end;
     /* Head of a local list for tracked object */
     struct List_Entry local_list_head;
+    /* Head of a local list for the tracked objects not reported, since they
+    do not change in the delta reporting mode */
+    struct List_Entry omitted_list_head;
+    uint64_t left_mac_keys[MAX_NUMBER_LEFT_DEVICES_PER_REPORT];
+    int number_left;
+    int current_time;
+    struct List_Entry *shard_head;
+    unsigned int shard_index;
+    unsigned int frozen_generation;
+    bool is_message_full = false;
+    bool is_frozen_empty = true;
+    DeviceShard *shard;
+    int i;
     DeviceType device_type = list->device_type;
     char hex_payload[LENGTH_OF_ADVERTISEMENT];
     char hex_scan_rsp[LENGTH_OF_ADVERTISEMENT];
+    char mac_address[LENGTH_OF_MAC_ADDRESS];
 
    
     /* Check input parameters to determine whether they are valid */
@@ -1597,18 +2873,16 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
         return E_INPUT_PARAMETER;
     }
 
-    pthread_mutex_lock(&list_lock);
-
     /* This code block is for debugging the linked list operations. In release
     version, we should not waste resource in iterating the linked list only
     ensure the correctness.
 
 
-    list_for_each(list_pointer, &list->list_entry){
+    list_for_each(list_pointer, &list->list_entries[0][0]){
         zlog_debug(category_debug,
-                   "Input list: list->list_entry %d list_pointer %d "
+                   "Input list: list->list_entries[0][0] %d list_pointer %d "
                    "prev %d next %d",
-                   &list->list_entry,
+                   &list->list_entries[0][0],
                    list_pointer,
                    list_pointer->prev,
                    list_pointer->next);
@@ -1616,54 +2890,117 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
 
     */
 
-    /* Set temporary pointer to point to the head of the input list */
-    head_pointer = list->list_entry.next;
-    tail_pointer = list->list_entry.next;
-    
-    /* Go through the input tracked_object list to move
-    number_to_send nodes in the list to a local list
+    init_entry(&local_list_head);
+    init_entry(&omitted_list_head);
+
+    /* The frozen generation is only changed here, and by the scanning 
+    threads for BR_EDR nodes under the lock of their shard, which leaves 
+    the heads of its parts alone. */
+    frozen_generation = (list->active_generation + 1) % NUMBER_GENERATIONS;
+
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
+        is_frozen_empty = 
+            is_frozen_empty &&
+            is_entry_list_empty(&list->list_entries[frozen_generation][i]);
+    }
+
+    /* Once the frozen generation has been reported entirely, swap it for
+    the active one, so that the scanning threads keep tracking into an empty
+    generation while the current one is reported. 
     */
-    
-    list_for_each(list_pointer, &list->list_entry){
+    if(is_frozen_empty){
 
-        temp = ListEntry(list_pointer, ScannedDevice, tr_list_entry);
+        frozen_generation = list->active_generation;
+
+        __atomic_store_n(&list->active_generation, 
+                         (frozen_generation + 1) % NUMBER_GENERATIONS,
+                         __ATOMIC_SEQ_CST);
+
+        /* The scanning threads and evict_tracked_devices() read the active
+        generation under the lock of a shard. Taking each lock once waits 
+        for the ones still working on the generation just frozen. */
+        for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
+            pthread_mutex_lock(&device_shards[i].lock);
+            pthread_mutex_unlock(&device_shards[i].lock);
+        }
+    }
+
+    /* Go through the shards of the frozen generation, starting from the one
+    the last message ran out of room in, to move number_to_send nodes in the
+    list to a local list. No other thread inserts, looks up or evicts BLE 
+    nodes in the frozen generation, so that they are moved without locking.
+    BR_EDR nodes are still found through the scanned list, and their shard 
+    is locked.
+    */
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS && !is_message_full ; i++){
+
+        shard_index = (list->next_shard + i) & (NUMBER_DEVICE_SHARDS - 1);
+        shard_head = &list->list_entries[frozen_generation][shard_index];
+
+        if(BR_EDR == device_type)
+            pthread_mutex_lock(&device_shards[shard_index].lock);
+
+        /* Set temporary pointer to point to the head of the shard */
+        head_pointer = shard_head->next;
+        tail_pointer = shard_head;
+
+        list_for_each(list_pointer, shard_head){
+
+            temp = ListEntry(list_pointer, ScannedDevice, tr_list_entry);
         
-        if(msg_remain_size > MAX_LENGTH_RESP_DEVICE_INFO){
+            if(msg_remain_size <= MAX_LENGTH_RESP_DEVICE_INFO){
+
+                /* Start from this shard next time */
+                list->next_shard = shard_index;
+                is_message_full = true;
+                break;
+            }
             
             number_to_send++;
+
+            /* The node is to be reported and released, so that it should
+            no longer be found by MAC address. */
+            if(NULL != list->hash_tables[frozen_generation]){
+                remove_device_hash_table(temp);
+            }
+
+            /* The node is moved to the local list below, so that it must
+            not be evicted meanwhile. */
+            remove_list_node(&temp->lru_list_entry);
             
             tail_pointer = list_pointer;
             
             msg_remain_size = 
                 msg_remain_size - 
                 MAX_LENGTH_RESP_DEVICE_INFO + 
-                (LENGTH_OF_ADVERTISEMENT - temp->payload_length);
-           
-        }else{
-            break;
+                (LENGTH_OF_ADVERTISEMENT - 
+                 (NULL == temp->payloads ? 0 : temp->payloads->payload_length));
         }
-    }
-       
-    /* Set the head of the input list to point to the last node */
-    list->list_entry.next = tail_pointer->next;
-    tail_pointer->next->prev = &list->list_entry;
 
-    pthread_mutex_unlock(&list_lock);
+        /* Move the nodes from head_pointer to tail_pointer to the tail of
+        the local list */
+        if(tail_pointer != shard_head){
 
- 
-    /*Check if number_to_send is zero. If yes, no need to do more. */
-    if(0 == number_to_send){
+            shard_head->next = tail_pointer->next;
+            tail_pointer->next->prev = shard_head;
+
+            head_pointer->prev = local_list_head.prev;
+            local_list_head.prev->next = head_pointer;
+            tail_pointer->next = &local_list_head;
+            local_list_head.prev = tail_pointer;
+        }
+
+        if(BR_EDR == device_type)
+            pthread_mutex_unlock(&device_shards[shard_index].lock);
+    }
+
+    /*Check if number_to_send is zero. If yes, no need to do more, unless the
+    devices which left are to be reported. */
+    if(0 == number_to_send && NULL == list->reported_states){
         sprintf(msg_buf, "%d;%d;", device_type, number_to_send);
         
         return WORK_SUCCESSFULLY;
     }
-    
-    /* Initialize the local list */
-    init_entry(&local_list_head);
-    local_list_head.next = head_pointer;
-    head_pointer->prev = &local_list_head;
-    local_list_head.prev = tail_pointer;
-    tail_pointer->next = &local_list_head;
 
     /* This code block is for debugging the linked list operations. In release
     version, we should not waste resource in iterating the linked list only
@@ -1681,15 +3018,26 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
     /* Insert device_type and number_to_send at the start of the track
     file
     */
-    list_for_each(list_pointer, &local_list_head){
+    current_time = get_system_time();
+
+    list_for_each_safe(list_pointer, save_list_pointers, &local_list_head){
 
         temp = ListEntry(list_pointer, ScannedDevice, tr_list_entry);
 
         if(temp->is_scan_rsp_needed &&
-           0 == temp->scan_rsp_length){
+           (NULL == temp->payloads || 0 == temp->payloads->scan_rsp_length)){
            // discard incomplete adv payload and scan_rsp payload when 
            // both fields are must-have       
            number_to_send--;
+
+        }else if(NULL != list->reported_states &&
+                 !is_report_needed(list->reported_states, temp, 
+                                   current_time)){
+
+            /* The device does not change since it is last reported */
+            remove_list_node(&temp->tr_list_entry);
+            insert_list_tail(&temp->tr_list_entry, &omitted_list_head);
+            number_to_send--;
         }
     }
     sprintf(msg_buf, "%d;%d;", device_type, number_to_send);
@@ -1706,7 +3054,7 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
         temp = ListEntry(list_pointer, ScannedDevice, tr_list_entry);
 
         if(temp->is_scan_rsp_needed && 
-           0 == temp->scan_rsp_length){
+           (NULL == temp->payloads || 0 == temp->payloads->scan_rsp_length)){
            // discard incomplete adv payload and scan_rsp payload when 
            // both fields are must-have       
             continue;
@@ -1718,26 +3066,33 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
         memset(hex_payload, 0, sizeof(hex_payload));
         memset(hex_scan_rsp, 0, sizeof(hex_scan_rsp));
         
-        if(temp->is_payload_needed){
-            get_printable_ble_payload(temp->payload,
-                                      temp->payload_length,
+        if(temp->is_payload_needed && NULL != temp->payloads){
+            get_printable_ble_payload(temp->payloads->payload,
+                                      temp->payloads->payload_length,
                                       hex_payload,
                                       sizeof(hex_payload));
-            get_printable_ble_payload(temp->scan_rsp,
-                                      temp->scan_rsp_length,
+            get_printable_ble_payload(temp->payloads->scan_rsp,
+                                      temp->payloads->scan_rsp_length,
                                       hex_scan_rsp,
                                       sizeof(hex_scan_rsp));
         }                         
+
+        convert_key_to_mac_address(temp->mac_key, mac_address);
        
         // note, when you change this part, please also update
         // MAX_LENGTH_RESP_DEVICE_INFO in LBeacon.h 
-        sprintf(response_buf, "%s;%d;%d;%d;%d;%d;%s%s;",
-                temp->scanned_mac_address,
+        sprintf(response_buf, "%s;%d;%d;%d;%d;%d;%u;%.1f;%.1f;%d;%.1f;%s%s;",
+                mac_address,
                 temp->initial_scanned_time,
                 temp->final_scanned_time,
-                temp->rssi,
+                temp->rssi_stats.max,
                 temp->is_button_pressed,
                 temp->battery_voltage,
+                temp->rssi_stats.count,
+                temp->rssi_stats.mean,
+                temp->rssi_stats.ewma,
+                temp->rssi_stats.min,
+                get_rssi_variance(&temp->rssi_stats),
                 hex_payload,
                 hex_scan_rsp);
    
@@ -1745,11 +3100,48 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
         strcat(msg_buf, response_buf);
     }
 
+    /* Append the number and the MAC addresses of the devices which left. 
+    The list is sized from msg_remain_size, the room left in the message 
+    after the devices above, keeping the room of one address for the 
+    number. The message may be nearly full, so that no device fits. */
+    if(NULL != list->reported_states){
+
+        number_left = 
+            get_left_devices(list->reported_states, 
+                             current_time,
+                             left_mac_keys,
+                             max(0, 
+                                 min(MAX_NUMBER_LEFT_DEVICES_PER_REPORT,
+                                     (int) (msg_remain_size / 
+                                            LENGTH_OF_MAC_ADDRESS) - 1)));
+
+        sprintf(response_buf, "%d;", number_left);
+        strcat(msg_buf, response_buf);
+
+        for(i = 0 ; i < number_left ; i++){
+
+            convert_key_to_mac_address(left_mac_keys[i], mac_address);
+            strcat(msg_buf, mac_address);
+            strcat(msg_buf, DELIMITER_SEMICOLON);
+        }
+    }
+
     /* Remove nodes from the local list. If the node is no longer in the scan
     list, release the allocated memory as well.
     */
     if(BLE == device_type){
 
+        /* The omitted nodes go with the reported ones */
+        list_for_each_safe(list_pointer,
+                           save_list_pointers,
+                           &omitted_list_head){
+
+            temp = ListEntry(list_pointer, ScannedDevice, tr_list_entry);
+
+            remove_list_node(&temp->tr_list_entry);
+            insert_list_tail(&temp->tr_list_entry, &local_list_head);
+        }
+
         list_for_each_safe(list_pointer,
                            save_list_pointers,
                            &local_list_head){
@@ -1758,14 +3150,14 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
 
             remove_list_node(&temp->tr_list_entry);
 
-            mp_free(&mempool, temp);
+            free_scanned_device(temp);
         }
 
     }else if(BR_EDR == device_type){
         /* If the device is of BR_EDR type, each node is linked into both
         the scanned list and the BR object list using sc_list_entry and
-        tr_list_entry. We should lock list_lock here to prevent scanned list
-        from being operated in other places at the same time.
+        tr_list_entry. We should lock the shard of the node here to prevent 
+        scanned list from being operated in other places at the same time.
         */
 
         list_for_each_safe(list_pointer,
@@ -1776,13 +3168,22 @@ ErrorCode consolidate_tracked_data(ObjectListHead *list,
 
             remove_list_node(&temp->tr_list_entry);
 
-            pthread_mutex_lock(&list_lock);
+            shard = &device_shards[get_device_shard_index(temp->mac_key)];
+
+            pthread_mutex_lock(&shard->lock);
 
             if(is_isolated_node(&temp->sc_list_entry)){
-                mp_free(&mempool, temp);
+                free_scanned_device(temp);
+            }else{
+                /* The node stays in the scanned list, and becomes subject
+                to eviction again. */
+                insert_lru_list_tail(
+                    temp, 
+                    &scanned_list_head.lru_list_entries[0]
+                        [get_device_shard_index(temp->mac_key)]);
             }
 
-            pthread_mutex_unlock(&list_lock);
+            pthread_mutex_unlock(&shard->lock);
         }
     }
 
@@ -1808,86 +3209,142 @@ const struct hci_request ble_hci_request(uint16_t ocf,
     return rq;
 }
 
-/* A static function to parse the specific data from the BLE device. */
-static ErrorCode eir_parse_specific_data(uint8_t *eir,
-                                         size_t eir_len,
-                                         uint8_t eir_type,
-                                         char *buf,
-                                         size_t buf_len){
+ErrorCode parse_ble_advertisement(uint8_t *eir,
+                                  size_t eir_len,
+                                  BleAdvertisement *advertisement){
     size_t offset;
     uint8_t field_len;
-    int index;
-    int i;
+
+    memset(advertisement, 0, sizeof(BleAdvertisement));
 
     offset = 0;
 
     while (offset < eir_len) {
-        field_len = eir[0];
+        field_len = eir[offset];
 
         /* Check for the end of EIR */
         if (field_len == 0)
             break;
 
-        if (offset + field_len > eir_len)
-            goto failed;
+        /* The AD structures found before a malformed one remain valid */
+        if (offset + field_len + 1 > eir_len)
+            return E_PARSE_UUID;
 
-        switch (eir[1]) {
+        switch (eir[offset + 1]) {
             case EIR_NAME_COMPLETE:
-                if(eir[1] != eir_type)
-                    break;
-                
-                if (field_len > buf_len)
-                    goto failed;
-                
-                memset(buf, 0, buf_len);
 
-                index = 0 ;
-                for(i = 0 ; i <= field_len ; i++){
-                    buf[index] = decimal_to_hex(eir[i] / 16);
-                    buf[index + 1]= decimal_to_hex(eir[i] % 16);                   
-                    index = index + 2;
+                if(NULL == advertisement->name_field){
+                    advertisement->name_field = &eir[offset];
+                    advertisement->name_field_length = field_len + 1;
                 }
-                buf[index] = '\0';
-                    
-                return WORK_SUCCESSFULLY;
+                break;
             case EIR_MANUFACTURE_SPECIFIC_DATA:
-                
-                if(eir[1] != eir_type)
-                    break;
-                
-                if (field_len > buf_len)
-                    goto failed;
-
-                // BiDaE tags
-                if(field_len == BLE_PAYLOAD_FORMAT_05C6_0XFF_FIELD_LEN || 
-                   field_len == BLE_PAYLOAD_FORMAT_05C7_0XFF_FIELD_LEN){
-                   
-                    memset(buf, 0, buf_len);
-
-                    index = 0 ;
-                    for(i = 0 ; i <= field_len ; i++){
-                        buf[index] = decimal_to_hex(eir[i] / 16);
-                        buf[index + 1]= decimal_to_hex(eir[i] % 16);                   
-                        index = index + 2;
+
+                if(NULL == advertisement->manufacturer_field){
+                    advertisement->manufacturer_field = &eir[offset];
+                    advertisement->manufacturer_field_length = field_len + 1;
+
+                    /* The company identifier is in little-endian order */
+                    if(field_len >= BLE_PAYLOAD_FORMAT_INDEX_OF_COMPANY_ID + 1){
+                        advertisement->company_id = 
+                            eir[offset + BLE_PAYLOAD_FORMAT_INDEX_OF_COMPANY_ID] |
+                            (eir[offset + BLE_PAYLOAD_FORMAT_INDEX_OF_COMPANY_ID + 1] << 8);
                     }
-                    buf[index] = '\0';
-                    
-                    return WORK_SUCCESSFULLY;
-                    
                 }
-
-                return E_PARSE_UUID;
+                break;
             default:
                 break;
-            }
+        }
 
         offset += field_len + 1;
-        eir += field_len + 1;
     }
 
-failed:
-    snprintf(buf, buf_len, NULL);
-    return E_PARSE_UUID;
+    return WORK_SUCCESSFULLY;
+}
+
+/* A static function decoding the BiDaETech button tag with panic and battery
+   voltage (identifier 05C6). */
+static void decode_tag_05C6(uint8_t *field, TagData *tag_data){
+
+    tag_data->is_button_pressed = 
+        field[BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_PANIC] & 0x0F;
+
+    // get the remaining battery voltage
+    tag_data->battery_voltage = field[BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_VOLTAGE];
+}
+
+/* A static function decoding the BiDaETech tag carrying a virtual MAC 
+   address (identifier 05C7). */
+static void decode_tag_05C7(uint8_t *field, TagData *tag_data){
+
+    size_t i;
+
+    tag_data->mac_key = 0;
+    for(i = 0 ; i < sizeof(bdaddr_t) ; i++){
+        tag_data->mac_key = (tag_data->mac_key << 8) |
+            field[BLE_PAYLOAD_FORMAT_05C7_INDEX_OF_MAC_ADDRESS + i];
+    }
+}
+
+/* A static function decoding the tag with panic (identifier 4153). */
+static void decode_tag_4153(uint8_t *field, TagData *tag_data){
+
+    tag_data->is_button_pressed = 
+        field[BLE_PAYLOAD_FORMAT_4153_INDEX_OF_PANIC] & 0x0F;
+}
+
+/* The table of all supported tag formats */
+static TagDecoder tag_decoders[] = {
+    {BIDAETECH_TAG_IDENTIFIER_05C6, TAG_DECODER_ANY_COMPANY_ID,
+     BLE_PAYLOAD_FORMAT_05C6_0XFF_FIELD_LEN, decode_tag_05C6},
+    {BIDAETECH_TAG_IDENTIFIER_05C7, TAG_DECODER_ANY_COMPANY_ID,
+     BLE_PAYLOAD_FORMAT_05C7_0XFF_FIELD_LEN, decode_tag_05C7},
+    {BIDAETECH_TAG_IDENTIFIER_4153, TAG_DECODER_ANY_COMPANY_ID,
+     BLE_PAYLOAD_FORMAT_4153_0XFF_FIELD_LEN, decode_tag_4153}
+};
+
+TagDecoder *get_tag_decoder(uint16_t identifier){
+
+    size_t i;
+
+    for(i = 0 ; i < sizeof(tag_decoders) / sizeof(tag_decoders[0]) ; i++){
+        if(tag_decoders[i].identifier == identifier)
+            return &tag_decoders[i];
+    }
+
+    return NULL;
+}
+
+bool decode_tag_data(uint16_t identifier,
+                     TagDecoder *decoder,
+                     BleAdvertisement *advertisement,
+                     TagData *tag_data){
+
+    uint8_t *field = advertisement->manufacturer_field;
+
+    if(BLE_PAYLOAD_IDENTIFIER_NO_PARSE == identifier)
+        return true;
+
+    if(NULL == decoder || NULL == field)
+        return false;
+
+    // check 0xFF payload (Manufacture Specific Data) for the length, 
+    // the tag identifier and the company id of the format
+    if(decoder->field_length != field[0])
+        return false;
+
+    if(decoder->identifier != 
+       ((field[BLE_PAYLOAD_FORMAT_INDEX_OF_IDENTIFER] << 8) |
+        field[BLE_PAYLOAD_FORMAT_INDEX_OF_IDENTIFER + 1]))
+        return false;
+
+    if(TAG_DECODER_ANY_COMPANY_ID != decoder->company_id &&
+       decoder->company_id != advertisement->company_id)
+        return false;
+
+    decoder->decode(field, tag_data);
+
+    return true;
 }
 
 static ErrorCode get_printable_ble_payload(uint8_t *in_buf,
@@ -1908,320 +3365,341 @@ static ErrorCode get_printable_ble_payload(uint8_t *in_buf,
     return WORK_SUCCESSFULLY;                                            
 }
 
+unsigned int get_examine_worker_index(uint64_t mac_key){
+
+    return get_device_shard_index(mac_key) % g_config.number_examine_workers;
+}
+
+/* A static function returning the slot of the negative cache into which the
+   input advertiser falls. */
+static inline unsigned int get_negative_cache_index(uint64_t mac_key,
+                                                    uint32_t signature){
+
+    return (((mac_key ^ ((uint64_t) signature << 16)) * 
+             DEVICE_HASH_MULTIPLIER) >> 32) & (SLOTS_IN_NEGATIVE_CACHE - 1);
+}
+
+uint32_t get_payload_signature(uint8_t *payload, size_t payload_length){
+
+    uint32_t signature = 2166136261U;
+    size_t i;
+
+    for(i = 0 ; i < payload_length ; i++){
+        signature ^= payload[i];
+        signature *= 16777619U;
+    }
+
+    return signature;
+}
+
+bool is_in_negative_cache(NegativeCache *cache, 
+                          uint64_t mac_key, 
+                          uint32_t signature,
+                          unsigned long long current_time_in_us){
+
+    unsigned int index = get_negative_cache_index(mac_key, signature);
+
+    if(mac_key == cache->mac_key[index] && 
+       signature == cache->signature[index] &&
+       current_time_in_us < cache->expiry_time_in_us[index]){
+
+        __atomic_store_n(&cache->number_hits, cache->number_hits + 1, 
+                         __ATOMIC_RELAXED);
+        return true;
+    }
+
+    __atomic_store_n(&cache->number_misses, cache->number_misses + 1,
+                     __ATOMIC_RELAXED);
+    return false;
+}
+
+void insert_negative_cache(NegativeCache *cache, 
+                           uint64_t mac_key, 
+                           uint32_t signature,
+                           unsigned long long current_time_in_us){
+
+    unsigned int index = get_negative_cache_index(mac_key, signature);
+
+    cache->mac_key[index] = mac_key;
+    cache->signature[index] = signature;
+    cache->expiry_time_in_us[index] = 
+        current_time_in_us + NEGATIVE_CACHE_TTL_IN_SEC * 1000000ULL;
+}
+
+void forward_scanned_ble_device(TempBleDevice *report){
+
+    SPSC_Queue *queue = 
+        &temp_ble_device_queues[get_examine_worker_index(report->mac_key)];
+    struct TempBleDevice *temp_node;
+
+    temp_node = (struct TempBleDevice*) spsc_reserve(queue);
+
+    if(NULL == temp_node){
+        /* The examining thread is falling behind. Drop this report. The 
+        drop is counted as an overflow of the queue and reported in the 
+        health report. */
+        return;
+    }
+
+    *temp_node = *report;
+
+    spsc_commit(queue);
+}
+
+void coalesce_scanned_ble_device(TempBleDevice *report){
+
+    CoalescedBleDevice *slot;
+    unsigned long long window_in_us = 
+        g_config.scan_coalescing_window_in_ms * 1000ULL;
+
+    /* The examining thread drops the adverts out of the coverage. Drop 
+    them here, so that they are not merged into the RSSI statistics of the
+    tag. */
+    if(report->rssi_stats.max < g_config.scan_rssi_coverage)
+        return;
+
+    if(EVENT_TYPE_SCAN_RSP == report->evt_type){
+        forward_scanned_ble_device(report);
+        return;
+    }
+
+    slot = &coalescing_cache.slots[
+        ((report->mac_key * DEVICE_HASH_MULTIPLIER) >> 32) & 
+        (SLOTS_IN_COALESCING_CACHE - 1)];
+
+    if(report->mac_key == slot->report.mac_key && 
+       report->payload_length == slot->report.payload_length &&
+       0 == memcmp(report->payload, slot->report.payload, 
+                   report->payload_length) &&
+       (slot->is_pending || 
+        report->read_time_in_us - slot->window_start_time_in_us < 
+        window_in_us)){
+
+        /* A repeated advert in the window of the tag. Its RSSI is added to
+        the statistics of the adverts merged so far. */
+        if(slot->is_pending){
+            merge_rssi_stats(&slot->report.rssi_stats, &report->rssi_stats);
+            report->rssi_stats = slot->report.rssi_stats;
+        }
+
+        __atomic_add_fetch(&le_advertising_stats.number_coalesced_reports, 
+                           1, __ATOMIC_RELAXED);
+
+        slot->report = *report;
+        slot->is_pending = true;
+        return;
+    }
+
+    if(report->mac_key == slot->report.mac_key){
+
+        /* The payload of the tag changed, e.g. its button is pressed, or 
+        its window ended without a flush. Forward the advert at once with 
+        the RSSI statistics merged so far. The adverts pending are counted
+        when they are merged. */
+        if(slot->is_pending){
+            merge_rssi_stats(&slot->report.rssi_stats, &report->rssi_stats);
+            report->rssi_stats = slot->report.rssi_stats;
+        }
+
+    }else if(slot->is_pending){
+
+        /* Another tag falls in the slot. Do not lose the last seen advert 
+        of the tag evicted. */
+        forward_scanned_ble_device(&slot->report);
+    }
+
+    /* The first advert of a tag in a window is forwarded at once, so that
+    the time it is first seen stays accurate. */
+    forward_scanned_ble_device(report);
+
+    slot->report = *report;
+    slot->is_pending = false;
+    slot->window_start_time_in_us = report->read_time_in_us;
+}
+
+void flush_coalescing_cache(unsigned long long current_time_in_us){
+
+    CoalescedBleDevice *slot;
+    unsigned long long window_in_us = 
+        g_config.scan_coalescing_window_in_ms * 1000ULL;
+    int i;
+
+    if(current_time_in_us < coalescing_cache.next_flush_time_in_us)
+        return;
+
+    coalescing_cache.next_flush_time_in_us = 
+        current_time_in_us + 
+        window_in_us / COALESCING_CACHE_FLUSHES_PER_WINDOW;
+
+    for(i = 0 ; i < SLOTS_IN_COALESCING_CACHE ; i++){
+
+        slot = &coalescing_cache.slots[i];
+
+        if(!slot->is_pending || 
+           current_time_in_us - slot->window_start_time_in_us < window_in_us)
+            continue;
+
+        /* Forward one report per window, carrying the last seen advert */
+        forward_scanned_ble_device(&slot->report);
+
+        slot->is_pending = false;
+        slot->window_start_time_in_us = current_time_in_us;
+    }
+}
+
 ErrorCode *examine_scanned_ble_device(void *param){
  
-    struct List_Entry *head_pointer, *tail_pointer;
-    /* Head of a local list for tracked object */
-    struct List_Entry local_list_head;
-    struct List_Entry *list_pointer, *save_list_pointers;
-    
+    /* The queue of the shards owned by this thread */
+    SPSC_Queue *queue = &temp_ble_device_queues[(intptr_t) param];
+    /* The cache of the advertisers of the shards matching no rule */
+    NegativeCache *negative_cache = &negative_caches[(intptr_t) param];
     struct TempBleDevice *temp;
-    bool is_empty_list;
-    int is_button_pressed;
-    int battery_voltage;
-    struct List_Entry *current_list_entry;
+    uint8_t mac_address[sizeof(bdaddr_t)];
     struct PrefixRule *mac_prefix_node;
     struct DeviceNamePrefix *device_name_node;
-    char payload[LENGTH_OF_ADVERTISEMENT];
+    BleAdvertisement advertisement;
+    TagData tag_data;
+    uint16_t identifier;
     bool is_matched = false;
     bool is_payload_needed = false;
     bool is_scan_rsp_needed = false;
-    char virtual_mac_address[LENGTH_OF_MAC_ADDRESS];
+    uint32_t signature;
+    size_t i;
     
     zlog_debug(category_debug, ">> examine_scanned_ble_device... ");
 
     while(true == ready_to_work){ 
     
-        pthread_mutex_lock(&temp_ble_device_list_lock);
-        
-        is_empty_list = is_entry_list_empty(&temp_ble_device_list_head);
-        
-        if(is_empty_list){
-            
-            pthread_mutex_unlock(&temp_ble_device_list_lock);
-            sleep_t(BUSY_WAITING_TIME_IN_MS);
+        temp = (struct TempBleDevice *) spsc_peek(queue);
+
+        if(NULL == temp){
+
+            /* Sleep until the scanning thread commits a new device. The 
+            timeout only bounds the time to notice ready_to_work is reset. */
+            spsc_wait(queue, BUSY_WAITING_TIME_IN_MS);
             continue;
         }
-            
-        head_pointer = temp_ble_device_list_head.next;   
-        tail_pointer = temp_ble_device_list_head.prev;  
 
-        temp_ble_device_list_head.next = tail_pointer->next;
-        tail_pointer->next->prev = &temp_ble_device_list_head;
-        
-        pthread_mutex_unlock(&temp_ble_device_list_lock);            
-        
-    
-        /* Initialize the local list */
-        init_entry(&local_list_head);
-        local_list_head.next = head_pointer;
-        head_pointer->prev = &local_list_head;
-        local_list_head.prev = tail_pointer;
-        tail_pointer->next = &local_list_head;
-        
-        list_for_each_safe(list_pointer,
-                           save_list_pointers,
-                           &local_list_head){
+        /*
+        zlog_debug(category_debug, "examine_scanned_ble_device " \
+                                   "[%012llX], [%d]", 
+                                   (unsigned long long) temp->mac_key, 
+                                   temp->rssi_stats.max);
+        */
 
-            temp = ListEntry(list_pointer, TempBleDevice, list_entry);
-            /*
-            zlog_debug(category_debug, "examine_scanned_ble_device " \
-                                       "[%s], [%d]", 
-                                       temp->scanned_mac_address, 
-                                       temp->rssi);
-            */
+        if(temp->rssi_stats.max < g_config.scan_rssi_coverage){
+            spsc_release(queue);
+            continue;
+        }
+
+        if(EVENT_TYPE_ADV_IND == temp->evt_type || 
+           EVENT_TYPE_ADV_NONCONN_IND == temp->evt_type){
+
+            /* Phones, earbuds and watches match no rule. Skip them with a 
+            single probe once they are known. */
+            signature = get_payload_signature(temp->payload, 
+                                              temp->payload_length);
 
-            if(temp->rssi < g_config.scan_rssi_coverage){
+            if(is_in_negative_cache(negative_cache, temp->mac_key, 
+                                    signature, temp->read_time_in_us)){
+                spsc_release(queue);
                 continue;
             }
-
-            if(EVENT_TYPE_ADV_IND == temp->evt_type || 
-               EVENT_TYPE_ADV_NONCONN_IND == temp->evt_type){
-                
-                is_button_pressed = 0;
-                battery_voltage = 0;
-                is_matched = false;
             
-                list_for_each(current_list_entry,
-                              &g_config.mac_prefix_list_head){
-                              
-                    mac_prefix_node = ListEntry(current_list_entry,
-                                                PrefixRule,
-                                                list_entry);
-                
-                    // check mac address prefix
-                    if(0 == strncmp(temp->scanned_mac_address, 
-                                    mac_prefix_node->prefix,
-                                    strlen(mac_prefix_node->prefix))){
-
-                        if(0 == strncmp(BLE_PAYLOAD_IDENTIFIER_NO_PARSE,
-                                        mac_prefix_node->identifier, 
-                                        strlen(BLE_PAYLOAD_IDENTIFIER_NO_PARSE))){
-                                            
-                            is_matched = true;
-                                
-                            is_payload_needed = false;
-                            is_scan_rsp_needed = false;
-                            
-                            zlog_debug(category_debug,
-                                       "Detected tag 0000 [LE]: %s - " \
-                                       "RSSI %4d, pushed=[%d], voltage=[%d]",
-                                       temp->scanned_mac_address,
-                                       temp->rssi,
-                                       is_button_pressed,
-                                       battery_voltage);
-                                               
-                            send_to_push_dongle(temp->scanned_mac_address,
-                                                BLE,
-                                                temp->rssi,
-                                                is_button_pressed,
-                                                battery_voltage,
-                                                is_payload_needed,
-                                                is_scan_rsp_needed,
-                                                temp->payload,
-                                                temp->payload_length);
-                            
-                        }else{
-                                  
-                            memset(payload, 0, sizeof(payload));
-
-                            // check 0xFF payload (Manufacture Specific Data)
-                            // for manufacture company id and length
-                            if(WORK_SUCCESSFULLY ==
-                               eir_parse_specific_data(temp->payload,
-                                                       temp->payload_length,
-                                                       EIR_MANUFACTURE_SPECIFIC_DATA,
-                                                       payload,
-                                                       sizeof(payload))){
-                        
-                                // check 0xFF contains specific tag identifier
-                                if(0 == strncmp(&payload[BLE_PAYLOAD_FORMAT_INDEX_OF_IDENTIFER],
-                                                mac_prefix_node->identifier, 
-                                                strlen(mac_prefix_node->identifier))){
-             
-                                    is_matched = true;
-                            
-                                    // parse payload as the tag identifier specified
-                                    if(0 == strncmp(mac_prefix_node->identifier,
-                                                    BIDAETECH_TAG_IDENTIFIER_05C6,
-                                                    strlen(BIDAETECH_TAG_IDENTIFIER_05C6))){                                       
-     
-                                        is_button_pressed = hex_to_decimal(payload[BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_PANIC]);
-
-                                        // get the remaining battery voltage
-                                        battery_voltage = 
-                                            hex_to_decimal(payload[BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_VOLTAGE]) * 16 +
-                                            hex_to_decimal(payload[BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_VOLTAGE + 1]); 
-                                
-                                        is_payload_needed = false;                                
-                                        is_scan_rsp_needed = false;                                
-                                
-                                        zlog_debug(category_debug,
-                                                   "Detected tag 05C6 [LE]: %s - " \
-                                                   "RSSI %4d, pushed=[%d], voltage=[%d]",
-                                                   temp->scanned_mac_address,
-                                                   temp->rssi,
-                                                   is_button_pressed,
-                                                   battery_voltage);
+            tag_data.is_button_pressed = 0;
+            tag_data.battery_voltage = 0;
+            tag_data.mac_key = temp->mac_key;
+            identifier = BLE_PAYLOAD_IDENTIFIER_NO_PARSE;
+            is_matched = false;
+
+            /* Walk the AD structures of the payload once for all the rules */
+            parse_ble_advertisement(temp->payload,
+                                    temp->payload_length,
+                                    &advertisement);
+
+            /* The MAC address in bytes, in the order of its string format */
+            for(i = 0 ; i < sizeof(bdaddr_t) ; i++){
+                mac_address[i] = 
+                    (temp->mac_key >> (8 * (sizeof(bdaddr_t) - 1 - i))) & 0xFF;
+            }
+
+            // check mac address prefix
+            mac_prefix_node = pt_match(&g_config.mac_prefix_trie,
+                                       mac_address,
+                                       NUMBER_DIGITS_OF_MAC_ADDRESS);
+
+            if(NULL != mac_prefix_node){
+
+                identifier = mac_prefix_node->identifier_value;
+                is_matched = decode_tag_data(identifier,
+                                             mac_prefix_node->decoder,
+                                             &advertisement,
+                                             &tag_data);
+                is_payload_needed = false;
+                is_scan_rsp_needed = false;
+            }
+        
+            // check device name EIR_NAME_COMPLETE
+            if(is_matched == false && NULL != advertisement.name_field){
                                                
-                                        send_to_push_dongle(temp->scanned_mac_address,
-                                                            BLE,
-                                                            temp->rssi,
-                                                            is_button_pressed,
-                                                            battery_voltage,
-                                                            is_payload_needed,
-                                                            is_scan_rsp_needed,
-                                                            temp->payload,
-                                                            temp->payload_length);
-                                    }
-                                    break;
-                                }
-                                break;
-                            } 
-                        }    
-                        break;
-                    } // if matched mac address prefix
-                }// list_for_each
-            
-                if(is_matched == false){
-                    // check device name EIR_NAME_COMPLETE
+                // check 0x09 matched one of device name prefixes
+                device_name_node = 
+                    pt_match(&g_config.device_name_prefix_trie,
+                             advertisement.name_field,
+                             advertisement.name_field_length * 2);
+
+                if(NULL != device_name_node){
+
+                    identifier = device_name_node->identifier_value;
+                    is_matched = decode_tag_data(identifier,
+                                                 device_name_node->decoder,
+                                                 &advertisement,
+                                                 &tag_data);
+                    is_payload_needed = device_name_node->is_payload_needed;
+                    is_scan_rsp_needed = device_name_node->is_scan_rsp_needed;
+                }
+            }
 
-                    memset(payload, 0, sizeof(payload));
+            if(is_matched){
+
+                zlog_debug(category_debug,
+                           "Detected tag %04X [LE]: %012llX - " \
+                           "RSSI %4d, pushed=[%d], voltage=[%d]",
+                           identifier,
+                           (unsigned long long) tag_data.mac_key,
+                           temp->rssi_stats.max,
+                           tag_data.is_button_pressed,
+                           tag_data.battery_voltage);
                 
-                    if(WORK_SUCCESSFULLY ==
-                           eir_parse_specific_data(temp->payload,
-                                                   temp->payload_length,
-                                                   EIR_NAME_COMPLETE,
-                                                   payload,
-                                                   sizeof(payload))){
-                                                   
-                        list_for_each(current_list_entry,
-                                      &g_config.device_name_prefix_list_head){
-                              
-                            device_name_node = ListEntry(current_list_entry,
-                                                         DeviceNamePrefix,
-                                                         list_entry); 
-                                          
-                            // check 0x09 matched one of device name prefixes
-                            if(0 == strncmp(&payload[0],
-                                            device_name_node->prefix, 
-                                            strlen(device_name_node->prefix))){
-                                            
-                                if(0 == strncmp(BLE_PAYLOAD_IDENTIFIER_NO_PARSE,
-                                                device_name_node->identifier, 
-                                                strlen(BLE_PAYLOAD_IDENTIFIER_NO_PARSE))){
-                                            
-                                    is_matched = true;
-                            
-                                    zlog_debug(category_debug,
-                                               "Detected tag 0000 [LE]: %s - " \
-                                               "RSSI %4d, pushed=[%d], voltage=[%d]",
-                                               temp->scanned_mac_address,
-                                               temp->rssi,
-                                               is_button_pressed,
-                                               battery_voltage);
-                       
-                                    send_to_push_dongle(temp->scanned_mac_address,
-                                                        BLE,
-                                                        temp->rssi,
-                                                        is_button_pressed,
-                                                        battery_voltage,
-                                                        device_name_node->is_payload_needed,
-                                                        device_name_node->is_scan_rsp_needed,
-                                                        temp->payload,
-                                                        temp->payload_length);
-                                }else{
-                                
-                                    memset(payload, 0, sizeof(payload));
-
-                                    // check 0xFF payload (Manufacture Specific Data)
-                                    // for manufacture company id and length
-                                    if(WORK_SUCCESSFULLY ==
-                                        eir_parse_specific_data(temp->payload,
-                                                                temp->payload_length,
-                                                                EIR_MANUFACTURE_SPECIFIC_DATA,
-                                                                payload,
-                                                                sizeof(payload))){
-                                     
-                                        // check 0xFF contains specific tag identifier
-                                        if(0 == strncmp(&payload[BLE_PAYLOAD_FORMAT_INDEX_OF_IDENTIFER],
-                                                        device_name_node->identifier, 
-                                                        strlen(device_name_node->identifier))){
-             
-                                            // parse payload as the tag identifier specified
-                                            if(0 == strncmp(device_name_node->identifier,
-                                                            BIDAETECH_TAG_IDENTIFIER_05C7,
-                                                            strlen(BIDAETECH_TAG_IDENTIFIER_05C7))){ 
-                                                        
-                                                is_matched = true;
-                            
-                                                memset(virtual_mac_address, 0, sizeof(virtual_mac_address));
-                                                convert_str_to_mac_address(&payload[BLE_PAYLOAD_FORMAT_05C7_INDEX_OF_MAC_ADDRESS],
-                                                                           &virtual_mac_address);
-                                            
-                                                zlog_debug(category_debug,
-                                                           "Detected tag 05C7 [LE]: %s - " \
-                                                           "RSSI %4d, pushed=[%d], voltage=[%d]", 
-                                                           virtual_mac_address,
-                                                           temp->rssi,
-                                                           is_button_pressed,
-                                                           battery_voltage);
-                                                       
-                                                send_to_push_dongle(virtual_mac_address,
-                                                                    BLE,
-                                                                    temp->rssi,
-                                                                    is_button_pressed,
-                                                                    battery_voltage,
-                                                                    device_name_node->is_payload_needed,
-                                                                    device_name_node->is_scan_rsp_needed,
-                                                                    temp->payload,
-                                                                    temp->payload_length);                                                       
-                                            }else if(0 == strncmp(device_name_node->identifier,
-                                                                  BIDAETECH_TAG_IDENTIFIER_4153,
-                                                                  strlen(BIDAETECH_TAG_IDENTIFIER_4153))){                                       
-                                                              
-                                                is_matched = true;
-                                            
-                                                is_button_pressed = 
-                                                    hex_to_decimal(payload[BLE_PAYLOAD_FORMAT_4153_INDEX_OF_PANIC]);
-
-                                                                
-                                                zlog_debug(category_debug,
-                                                           "Detected tag 4153 [LE]: %s - " \
-                                                           "RSSI %4d, pushed=[%d], voltage=[%d]",
-                                                           temp->scanned_mac_address,
-                                                           temp->rssi,
-                                                           is_button_pressed,
-                                                           battery_voltage);
-                                               
-                                                send_to_push_dongle(temp->scanned_mac_address,
-                                                                    BLE,
-                                                                    temp->rssi,
-                                                                    is_button_pressed,
-                                                                    battery_voltage,
-                                                                    device_name_node->is_payload_needed,
-                                                                    device_name_node->is_scan_rsp_needed,
-                                                                    temp->payload,
-                                                                    temp->payload_length);
-                                            }
-                                        }
-                                    }
-                                }
-                                break;
-                            } // if
-                        } // list for each                   
-                    }
-                }                    
-            }// if evt_type == EVENT_TYPE_ADV_IND or EVENT_TYPE_ADV_NONCONN_ADV
-            else if(EVENT_TYPE_SCAN_RSP == temp->evt_type){
-                send_to_push_dongle_scan_rsp(temp->scanned_mac_address,
-                                             BLE,
-                                             temp->payload,
-                                             temp->payload_length);
-            }// if evt_type == EVENT_TYPE_SCAN_RSP
-            
-            mp_free(&temp_ble_device_mempool, temp);
-        }
+                /* The accept list holds the advertiser, which differs from
+                the tag reported if the tag carries a virtual MAC address */
+                if(g_config.scan_accept_list_enabled){
+                    learn_known_tag(temp->mac_key, temp->bdaddr_type, false);
+                }
+
+                send_to_push_dongle(tag_data.mac_key,
+                                    BLE,
+                                    &temp->rssi_stats,
+                                    tag_data.is_button_pressed,
+                                    tag_data.battery_voltage,
+                                    is_payload_needed,
+                                    is_scan_rsp_needed,
+                                    temp->payload,
+                                    temp->payload_length,
+                                    temp->read_time_in_us);
+            }else{
+                insert_negative_cache(negative_cache, temp->mac_key,
+                                      signature, temp->read_time_in_us);
+            }
+        }// if evt_type == EVENT_TYPE_ADV_IND or EVENT_TYPE_ADV_NONCONN_ADV
+        else if(EVENT_TYPE_SCAN_RSP == temp->evt_type){
+            send_to_push_dongle_scan_rsp(temp->mac_key,
+                                         BLE,
+                                         temp->payload,
+                                         temp->payload_length);
+        }// if evt_type == EVENT_TYPE_SCAN_RSP
+        
+        spsc_release(queue);
     }
     
     zlog_debug(category_debug, "<< examine_scanned_ble_device... ");
@@ -2231,25 +3709,37 @@ ErrorCode *examine_scanned_ble_device(void *param){
 ErrorCode *start_ble_scanning(void *param){
     /* A buffer for the callback event */
     uint8_t ble_buffer[HCI_MAX_EVENT_SIZE];
-    int socket = 0; /* socket number */
+    HCI_Transport transport; /* the source of HCI events */
     int dongle_device_id = 0; /* dongle id */
     int ret, opt, status, len;
     struct hci_filter new_filter; /* Filter for controlling the events*/
     evt_le_meta_event *meta;
     le_advertising_info *info;
     le_set_event_mask_cp event_mask_cp;
-    int retry_times = 0;
     struct hci_request scan_params_rq;
     struct hci_request set_mask_rq;
     int i=0;
     uint8_t reports_count;
     int rssi;
-    char address[LENGTH_OF_MAC_ADDRESS];
     struct TempBleDevice *temp_node;
-    int scan_type = 0x01; // 0x00: passive scan, 0x01: active_scan
-    int own_type = 0x00;
-    int filter_policy = 0x00;
-    char hex_payload[1024];
+    struct TempBleDevice report;
+    SPSC_Queue *queue;
+    uint64_t mac_key;
+    /* The time the event is read, to measure the latency of panic alerts */
+    unsigned long long read_time_in_us;
+    uint8_t *report_pointer;
+    uint8_t *buffer_end;
+    int scan_type = 0x00; // 0x00: passive scan, 0x01: active_scan
+    uint8_t accept_list_size = 0;
+    int current_time;
+    int last_discovery_time = 0;
+    bool is_discovery = true;
+    bool is_rearm_needed;
+    /* The time to re-arm the scanning, or 0 if it is never re-armed */
+    int next_rearm_time = 0;
+    /* The time to switch the type of the hybrid scanning, or 0 if the type
+    never changes */
+    int next_scan_type_time = 0;
 
     zlog_debug(category_debug, ">> start_ble_scanning... ");
 
@@ -2274,157 +3764,282 @@ ErrorCode *start_ble_scanning(void *param){
         return E_OPEN_DEVICE;
     }
 
-    /* Open Bluetooth device */
-    retry_times = SOCKET_OPEN_RETRY;
-    while(retry_times--){
-        socket = hci_open_dev(dongle_device_id);
+    /* Open the source of HCI events */
+    if(WORK_SUCCESSFULLY != 
+       open_hci_transport(&transport, dongle_device_id, EVT_LE_META_EVENT)){
+        return E_OPEN_SOCKET;
+    }
 
-        if(socket >= 0){
-            break;
+    /* Only a real dongle is configured. The other transports emit events 
+    without any HCI command. */
+    if(HCI_TRANSPORT_SOCKET == transport.type){
+
+        if(g_config.scan_accept_list_enabled &&
+           0> hci_le_read_white_list_size(transport.socket, 
+                                          &accept_list_size,
+                                          HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+
+            zlog_info(category_health_report,
+                      "Error reading the size of accept list");
+            zlog_debug(category_debug,
+                       "Error reading the size of accept list");
         }
-    }
-    
-    if (socket < 0) {
-        zlog_error(category_health_report,
-                   "Error openning socket");
-        zlog_error(category_debug,
-                   "Error openning socket");
-         return E_OPEN_SOCKET;
-    }
 
-    /* Set BLE scan parameters */
-    if( 0> hci_le_set_scan_parameters(socket, 
-                                      scan_type, 
-                                      htobs((uint16_t)g_config.scan_interval_in_units_0625_ms),
-                                      htobs((uint16_t)g_config.scan_window_in_units_0625_ms),
-                                      own_type,
-                                      filter_policy,
-                                      HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+        /* Scan requests are only sent if some rule needs the scan 
+        responses */
+        if(g_config.is_active_scan_needed)
+            scan_type = 0x01;
 
-        zlog_info(category_health_report,
-                  "Error setting parameters of BLE scanning");
-        zlog_debug(category_debug,
-                  "Error setting parameters of BLE scanning");
+        /* Start with accepting all devices, since no tag is learned yet */
+        set_ble_scanning(transport.socket, scan_type, accept_list_size, 
+                         is_discovery);
+
+        last_discovery_time = get_system_time();
+
+        if(g_config.is_active_scan_needed && g_config.scan_hybrid_enabled &&
+           0 < g_config.scan_hybrid_active_window_in_sec &&
+           0 < g_config.scan_hybrid_passive_window_in_sec){
+            next_scan_type_time = 
+                last_discovery_time + g_config.scan_hybrid_active_window_in_sec;
+        }
+
+        if(0 < g_config.scan_rearm_interval_in_sec &&
+           (g_config.scan_accept_list_enabled || 
+            g_config.scan_duplicate_filter_enabled)){
+            next_rearm_time = 
+                last_discovery_time + g_config.scan_rearm_interval_in_sec;
+        }
+
+        /* Set event mask */
+        memset(&event_mask_cp, 0, sizeof(le_set_event_mask_cp));
+
+        for (i = 0 ; i < 8 ; i++ ){
+            event_mask_cp.mask[i] = 0xFF;
+        }
+
+        set_mask_rq = ble_hci_request(OCF_LE_SET_EVENT_MASK,
+                                      LE_SET_EVENT_MASK_CP_SIZE,
+                                      &status, &event_mask_cp);
+        ret = hci_send_req(transport.socket, &set_mask_rq,
+                           HCI_SEND_REQUEST_TIMEOUT_IN_MS);
+
+        if ( ret < 0 ) {
+            ht_close(&transport);
+            return E_SCAN_SET_EVENT_MASK;
+        }
+
+        /* Set filter */
+        hci_filter_clear(&new_filter);
+        hci_filter_set_ptype(HCI_EVENT_PKT, &new_filter);
+        hci_filter_set_event(EVT_LE_META_EVENT, &new_filter);
+
+        if (0 > setsockopt(transport.socket, SOL_HCI, HCI_FILTER, 
+                           &new_filter, sizeof(new_filter)) ) {
+            /* Error handling */
+            ht_close(&transport);
+
+            zlog_error(category_health_report,
+                       "Error setting HCI filter");
+            zlog_error(category_debug,
+                       "Error setting HCI filter");
+            
+            return E_SCAN_SET_EVENT_MASK; 
+        }
     }
 
+    is_ble_scanning_thread_running = true;
 
-    if( 0> hci_le_set_scan_enable(socket, 
-                                  0x01, 
-                                  0,
-                                  HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+    while(true == ready_to_work){
+
+        current_time = get_system_time();
+        is_rearm_needed = false;
 
-        zlog_info(category_health_report,
-                  "Error enabling BLE scanning");
-        zlog_debug(category_debug,
-                   "Error enabling BLE scanning");
-    }
+        if(0 != next_scan_type_time && current_time >= next_scan_type_time){
 
+            /* Alternate between a short active window and a long passive 
+            one */
+            if(0x01 == scan_type){
+                scan_type = 0x00;
+                next_scan_type_time = 
+                    current_time + g_config.scan_hybrid_passive_window_in_sec;
+            }else{
+                scan_type = 0x01;
+                next_scan_type_time = 
+                    current_time + g_config.scan_hybrid_active_window_in_sec;
+            }
 
-    /* Set event mask */
-    memset(&event_mask_cp, 0, sizeof(le_set_event_mask_cp));
+            is_rearm_needed = true;
+        }
 
-    for (i = 0 ; i < 8 ; i++ ){
-        event_mask_cp.mask[i] = 0xFF;
-    }
+        if(0 != next_rearm_time && current_time >= next_rearm_time){
 
-    set_mask_rq = ble_hci_request(OCF_LE_SET_EVENT_MASK,
-                                  LE_SET_EVENT_MASK_CP_SIZE,
-                                  &status, &event_mask_cp);
-    ret = hci_send_req(socket, &set_mask_rq,
-                       HCI_SEND_REQUEST_TIMEOUT_IN_MS);
+            /* Accept all devices for one re-arm interval once in a while, 
+            so that the tags not in the accept list are learned. */
+            is_discovery = (current_time - last_discovery_time >= 
+                            g_config.scan_discovery_interval_in_sec);
 
-    if ( ret < 0 ) {
-        hci_close_dev(socket);
-        return E_SCAN_SET_EVENT_MASK;
-    }
+            if(is_discovery)
+                last_discovery_time = current_time;
 
-    /* Set filter */
-    hci_filter_clear(&new_filter);
-    hci_filter_set_ptype(HCI_EVENT_PKT, &new_filter);
-    hci_filter_set_event(EVT_LE_META_EVENT, &new_filter);
+            next_rearm_time = current_time + g_config.scan_rearm_interval_in_sec;
+            is_rearm_needed = true;
+        }
 
-    if (0 > setsockopt(socket, SOL_HCI, HCI_FILTER, &new_filter,
-                       sizeof(new_filter)) ) {
-        /* Error handling */
-        hci_close_dev(socket);
+        if(is_rearm_needed){
+            set_ble_scanning(transport.socket, scan_type,
+                             accept_list_size, is_discovery);
+        }
 
-        zlog_error(category_health_report,
-                   "Error setting HCI filter");
-        zlog_error(category_debug,
-                   "Error setting HCI filter");
-            
-        return E_SCAN_SET_EVENT_MASK; 
-    }
+        /* Forward the merged reports even if no adverts are read */
+        if(g_config.scan_coalescing_enabled)
+            flush_coalescing_cache(get_clock_time_in_us());
 
-    is_ble_scanning_thread_running = true;
+        len = 0;
 
-    while(true == ready_to_work){
         while(true == ready_to_work && 
               (HCI_EVENT_HDR_SIZE <=
-               read(socket, ble_buffer, sizeof(ble_buffer)))){
+               (len = ht_read_event(&transport, 
+                                    ble_buffer, 
+                                    sizeof(ble_buffer),
+                                    BUSY_WAITING_TIME_IN_MS)))){
+
+            read_time_in_us = get_clock_time_in_us();
+
+            if(g_config.scan_coalescing_enabled)
+                flush_coalescing_cache(read_time_in_us);
+
+            /* The event must hold the packet type, the event header, the 
+            subevent code and the number of reports. */
+            if(len < HCI_EVENT_HDR_SIZE + 3)
+                continue;
+
+            /* Replayed captures may hold events other than LE meta events */
+            if(EVT_LE_META_EVENT != ble_buffer[1])
+                continue;
 
             meta = (evt_le_meta_event*)
                 (ble_buffer + HCI_EVENT_HDR_SIZE + 1);
 
-            if(EVT_LE_ADVERTISING_REPORT == meta->subevent){
-                info = (le_advertising_info *)(meta->data + 1);
-                
-        
+            if(EVT_LE_ADVERTISING_REPORT != meta->subevent)
+                continue;
+
+            /* A controller may batch several reports into one event. The 
+            reports are of variable length and follow one another. */
+            reports_count = meta->data[0];
+            report_pointer = meta->data + 1;
+            buffer_end = ble_buffer + len;
+
+            for(i = 0 ; i < reports_count ; i++){
+
+                info = (le_advertising_info *) report_pointer;
+
+                /* Each report is followed by a byte of RSSI. Stop at the 
+                first report which does not fit in the bytes read. */
+                if(report_pointer + LE_ADVERTISING_INFO_SIZE > buffer_end ||
+                   report_pointer + LE_ADVERTISING_INFO_SIZE + 
+                   info->length + 1 > buffer_end){
+
+                    __atomic_add_fetch(
+                        &le_advertising_stats.number_malformed_events, 1, 
+                        __ATOMIC_RELAXED);
+                    break;
+                }
+
+                report_pointer += LE_ADVERTISING_INFO_SIZE + info->length + 1;
+
                 if(EVENT_TYPE_ADV_IND  == info->evt_type || 
                    EVENT_TYPE_ADV_NONCONN_IND == info->evt_type || 
                    EVENT_TYPE_SCAN_RSP == info->evt_type){
+
+                    if(info->length > sizeof(temp_node->payload))
+                        continue;
                           
-                    ba2str(&info->bdaddr, address);
-                    strcat(address, "\0");               
-               
                     /* the rssi is in the next byte after the packet*/
                     rssi = (signed char)info->data[info->length];
                 
-                    temp_node = (struct TempBleDevice*) mp_alloc(&temp_ble_device_mempool);
+                    mac_key = convert_bdaddr_to_key(&info->bdaddr);
+
+                    if(g_config.scan_coalescing_enabled){
+
+                        report.mac_key = mac_key;
+                        report.bdaddr_type = info->bdaddr_type;
+                        report.evt_type = info->evt_type;
+                        memcpy(report.payload, info->data, info->length);
+                        report.payload_length = info->length;
+                        init_rssi_stats(&report.rssi_stats, rssi);
+                        report.read_time_in_us = read_time_in_us;
+
+                        coalesce_scanned_ble_device(&report);
+                        continue;
+                    }
+
+                    /* Pass the device to the examining thread owning its 
+                    shard */
+                    queue = &temp_ble_device_queues[
+                        get_examine_worker_index(mac_key)];
+
+                    temp_node = (struct TempBleDevice*) spsc_reserve(queue);
                 
                     if(NULL == temp_node){
-                        zlog_error(category_health_report,
-                                   "Unable to get memory from mp_alloc(). "
-                                   "Skip this new device.");
-                        zlog_error(category_debug,
-                                   "Unable to get memory from mp_alloc(). "
-                                   "Skip this new device.");
+                        /* The examining thread is falling behind. Drop this
+                        report. The drop is counted as an overflow of the
+                        queue and reported in the health report. */
                         continue;
                     }
                 
-                    memset(temp_node, 0, sizeof(TempBleDevice));
-                
-                    init_entry(&temp_node->list_entry);
-                
-                    strcpy(temp_node -> scanned_mac_address, address);
+                    temp_node -> mac_key = mac_key;
+                    temp_node -> bdaddr_type = info->bdaddr_type;
                     temp_node -> evt_type = info->evt_type;
                     memcpy(temp_node -> payload, info->data, info->length);
                     temp_node -> payload_length = info->length;
-                    temp_node -> rssi = rssi;
+                    init_rssi_stats(&temp_node -> rssi_stats, rssi);
+                    temp_node -> read_time_in_us = read_time_in_us;
                 
                     /*
                     zlog_debug(category_debug, "start_ble_scanning scanned " \
-                                               "[%s], [%d], [%d]", 
-                                               temp_node->scanned_mac_address, 
+                                               "[%012llX], [%d], [%d]", 
+                                               (unsigned long long) temp_node->mac_key, 
                                                temp_node->payload_length,
-                                               temp_node->rssi);
+                                               temp_node->rssi_stats.max);
                     */
-                    pthread_mutex_lock(&temp_ble_device_list_lock);
-                
-                    insert_list_tail(&temp_node->list_entry,
-                                     &temp_ble_device_list_head);
-                
-                    pthread_mutex_unlock(&temp_ble_device_list_lock);  
+                    spsc_commit(queue);
                 }               
             }
+
+            /* Count the reports per event to see how much the controller 
+            batches */
+            __atomic_add_fetch(&le_advertising_stats.number_events, 1,
+                               __ATOMIC_RELAXED);
+            __atomic_add_fetch(&le_advertising_stats.number_reports, i,
+                               __ATOMIC_RELAXED);
+
+            /* i is the number of reports of the event, never negative */
+            if((unsigned int) i > le_advertising_stats.max_reports_per_event){
+                __atomic_store_n(&le_advertising_stats.max_reports_per_event,
+                                 (unsigned int) i, __ATOMIC_RELAXED);
+            }
+
+            /* Leave the reading loop to re-arm the scanning on time */
+            current_time = get_system_time();
+
+            if((0 != next_rearm_time && current_time >= next_rearm_time) ||
+               (0 != next_scan_type_time && 
+                current_time >= next_scan_type_time))
+                break;
         } // end while (HCI_EVENT_HDR_SIZE)
+
+        /* The transport fails, e.g. the socket cannot be polled or the 
+        capture holds no event. Wait before retrying instead of spinning. */
+        if(0 > len)
+            sleep_t(BUSY_WAITING_TIME_IN_MS);
             
     } // end while
     
-    if( 0> hci_le_set_scan_enable(socket, 
-                                  0, 
-                                  0,
-                                  HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
+    if(HCI_TRANSPORT_SOCKET == transport.type &&
+       0> hci_le_set_scan_enable(transport.socket, 
+                                 0, 
+                                 0,
+                                 HCI_SEND_REQUEST_TIMEOUT_IN_MS)){
 
         zlog_error(category_health_report,
                    "Error disabling BLE scanning");
@@ -2432,7 +4047,7 @@ ErrorCode *start_ble_scanning(void *param){
                    "Error disabling BLE scanning");
     } 
         
-    hci_close_dev(socket);
+    ht_close(&transport);
     is_ble_scanning_thread_running = false;
 
     zlog_debug(category_debug, "<< start_ble_scanning... ");
@@ -2441,7 +4056,6 @@ ErrorCode *start_ble_scanning(void *param){
 
 ErrorCode *start_br_scanning(void* param) {
     struct hci_filter filter; /*filter for controlling the events*/
-    struct pollfd output; /*a callback event from the socket */
     unsigned char event_buffer[HCI_MAX_EVENT_SIZE]; /*a buffer for the
                                                       callback event */
     unsigned char *event_buffer_pointer; /*a pointer for the event buffer */
@@ -2453,15 +4067,17 @@ ErrorCode *start_br_scanning(void* param) {
     inquiry_info *info; /*a record of EVT_INQUIRY_RESULT message */
     int event_buffer_length; /*length of the event buffer */
     int dongle_device_id = 1; /*dongle id */
-    int socket = 0; /*socket number*/
+    HCI_Transport transport; /*the source of HCI events */
     int results; /*the result returned via the socket */
     int results_id; /*ID of the result */
     int retry_times = 0;
     bool keep_scanning;
     int rssi;
+    RssiStats rssi_stats;
     int is_button_pressed = 0;
     int battery_voltage = 0;
-    char address[LENGTH_OF_MAC_ADDRESS];
+    uint64_t mac_key;
+    unsigned long long read_time_in_us;
     bool is_payload_needed = false;
     bool is_scan_rsp_needed = false;
     uint8_t payload[LENGTH_OF_ADVERTISEMENT];
@@ -2471,8 +4087,10 @@ ErrorCode *start_br_scanning(void* param) {
 
     while(true == ready_to_work){
         /* Open Bluetooth device */
+        dongle_device_id = -1;
         retry_times = DONGLE_GET_RETRY;
-        while(retry_times--){
+        while(HCI_TRANSPORT_SOCKET == g_config.scan_hci_transport &&
+              retry_times--){
             dongle_device_id = hci_get_route(NULL);
 
             if(dongle_device_id >= 0){
@@ -2480,7 +4098,8 @@ ErrorCode *start_br_scanning(void* param) {
             }
         }
 
-        if(dongle_device_id < 0){
+        if(HCI_TRANSPORT_SOCKET == g_config.scan_hci_transport &&
+           dongle_device_id < 0){
 
             zlog_error(category_health_report,
                        "Error openning the device");
@@ -2489,84 +4108,77 @@ ErrorCode *start_br_scanning(void* param) {
             return E_OPEN_DEVICE;
         }
 
-        retry_times = SOCKET_OPEN_RETRY;
-        while(retry_times--){
-            socket = hci_open_dev(dongle_device_id);
-
-            if(socket >= 0){
-                break;
-            }
-        }
-
-        if (socket < 0 ){
-            zlog_error(category_health_report,
-                       "Error openning socket");
-            zlog_error(category_debug,
-                       "Error openning socket");
+        if(WORK_SUCCESSFULLY != 
+           open_hci_transport(&transport, 
+                              dongle_device_id, 
+                              EVT_INQUIRY_RESULT_WITH_RSSI)){
             return E_OPEN_SOCKET;
         }
 
-        /* Setup filter */
-        hci_filter_clear(&filter);
-        hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
-        hci_filter_set_event(EVT_INQUIRY_RESULT, &filter);
-        hci_filter_set_event(EVT_INQUIRY_RESULT_WITH_RSSI, &filter);
-        hci_filter_set_event(EVT_INQUIRY_COMPLETE, &filter);
-
-        if (0 > setsockopt(socket, SOL_HCI, HCI_FILTER, &filter,
-                           sizeof(filter))) {
-
-            zlog_error(category_health_report,
-                       "Error setting HCI filter");
-            zlog_error(category_debug,
-                       "Error setting HCI filter");
-            hci_close_dev(socket);
-            return E_SCAN_SET_HCI_FILTER;
-        }
-
-        hci_write_inquiry_mode(socket, 0x01, 10);
-
-        if (0 > hci_send_cmd(socket, OGF_HOST_CTL, OCF_WRITE_INQUIRY_MODE,
-                             WRITE_INQUIRY_MODE_RP_SIZE, &inquiry_copy)) {
-            /* Error handling */
-            zlog_error(category_health_report,
-                       "Error setting inquiry mode");
-            zlog_error(category_debug,
-                       "Error setting inquiry mode");
-            hci_close_dev(socket);
-            return E_SCAN_SET_INQUIRY_MODE;
-        }
-
-        memset(&inquiry_copy, 0, sizeof(inquiry_copy));
-
-        /* Use the global inquiry access code (GIAC), which has
-        0x338b9e as its lower address part (LAP)
-        */
-        inquiry_copy.lap[2] = 0x9e;
-        inquiry_copy.lap[1] = 0x8b;
-        inquiry_copy.lap[0] = 0x33;
+        /* Only a real dongle is configured and starts an inquiry. The other
+        transports emit events without any HCI command. */
+        if(HCI_TRANSPORT_SOCKET == transport.type){
+
+            /* Setup filter */
+            hci_filter_clear(&filter);
+            hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+            hci_filter_set_event(EVT_INQUIRY_RESULT, &filter);
+            hci_filter_set_event(EVT_INQUIRY_RESULT_WITH_RSSI, &filter);
+            hci_filter_set_event(EVT_INQUIRY_COMPLETE, &filter);
+
+            if (0 > setsockopt(transport.socket, SOL_HCI, HCI_FILTER, &filter,
+                               sizeof(filter))) {
+
+                zlog_error(category_health_report,
+                           "Error setting HCI filter");
+                zlog_error(category_debug,
+                           "Error setting HCI filter");
+                ht_close(&transport);
+                return E_SCAN_SET_HCI_FILTER;
+            }
 
-        /* No limit on number of responses per scan */
-        inquiry_copy.num_rsp = 0;
-        /* Time unit is 1.28 seconds */
-        inquiry_copy.length = 0x06; /* 6*1.28 = 7.68 seconds */
+            hci_write_inquiry_mode(transport.socket, 0x01, 10);
+
+            if (0 > hci_send_cmd(transport.socket, OGF_HOST_CTL, 
+                                 OCF_WRITE_INQUIRY_MODE,
+                                 WRITE_INQUIRY_MODE_RP_SIZE, &inquiry_copy)) {
+                /* Error handling */
+                zlog_error(category_health_report,
+                           "Error setting inquiry mode");
+                zlog_error(category_debug,
+                           "Error setting inquiry mode");
+                ht_close(&transport);
+                return E_SCAN_SET_INQUIRY_MODE;
+            }
 
-        zlog_debug(category_debug, "Starting inquiry with RSSI...");
+            memset(&inquiry_copy, 0, sizeof(inquiry_copy));
 
-        if (0 > hci_send_cmd(socket, OGF_LINK_CTL, OCF_INQUIRY,
-                             INQUIRY_CP_SIZE, &inquiry_copy)) {
-            /* Error handling */
-            zlog_error(category_health_report,
-                       "Error starting inquiry");
-            zlog_error(category_debug,
-                       "Error starting inquiry");
-            hci_close_dev(socket);
-            return E_SCAN_START_INQUIRY;
+            /* Use the global inquiry access code (GIAC), which has
+            0x338b9e as its lower address part (LAP)
+            */
+            inquiry_copy.lap[2] = 0x9e;
+            inquiry_copy.lap[1] = 0x8b;
+            inquiry_copy.lap[0] = 0x33;
+
+            /* No limit on number of responses per scan */
+            inquiry_copy.num_rsp = 0;
+            /* Time unit is 1.28 seconds */
+            inquiry_copy.length = 0x06; /* 6*1.28 = 7.68 seconds */
+
+            zlog_debug(category_debug, "Starting inquiry with RSSI...");
+
+            if (0 > hci_send_cmd(transport.socket, OGF_LINK_CTL, OCF_INQUIRY,
+                                 INQUIRY_CP_SIZE, &inquiry_copy)) {
+                /* Error handling */
+                zlog_error(category_health_report,
+                           "Error starting inquiry");
+                zlog_error(category_debug,
+                           "Error starting inquiry");
+                ht_close(&transport);
+                return E_SCAN_START_INQUIRY;
+            }
         }
 
-        output.fd = socket;
-        output.events = POLLIN | POLLERR | POLLHUP;
-
         /* An indicator for continuing to scan the devices. */
         /* After the inquiring events completing, it should jump
         out of the while loop for getting a new socket
@@ -2575,83 +4187,88 @@ ErrorCode *start_br_scanning(void* param) {
         keep_scanning = true;
 
         while (true == keep_scanning) {
-            output.revents = 0;
-            /* Poll the bluetooth device for an event */
-            if (0 < poll(&output, 1, -1)) {
-
-                event_buffer_length =
-                    read(socket, event_buffer, sizeof(event_buffer));
+            /* Wait the bluetooth device for an event */
+            event_buffer_length = ht_read_event(&transport,
+                                                event_buffer, 
+                                                sizeof(event_buffer),
+                                                BUSY_WAITING_TIME_IN_MS);
 
-                if (0 > event_buffer_length) {
-                    continue;
-                }else if (0 == event_buffer_length) {
+            if (0 > event_buffer_length) {
+                break;
+            }else if (HCI_EVENT_HDR_SIZE >= event_buffer_length) {
+                /* No event yet. Check whether to stop scanning. */
+                if (false == ready_to_work) {
                     break;
                 }
+                continue;
+            }
 
-                event_handler = (void *)(event_buffer + 1);
-                event_buffer_pointer =
-                    event_buffer + (1 + HCI_EVENT_HDR_SIZE);
-                results = event_buffer_pointer[0];
-
-                switch (event_handler->evt) {
-                /* Scanned device with no RSSI value */
-                case EVT_INQUIRY_RESULT: {
-                    for (results_id = 0; results_id < results; results_id++){
-                        info = (void *)event_buffer_pointer +
-                               (sizeof(*info) * results_id) + 1;
-                    }
+            read_time_in_us = get_clock_time_in_us();
+
+            event_handler = (void *)(event_buffer + 1);
+            event_buffer_pointer =
+                event_buffer + (1 + HCI_EVENT_HDR_SIZE);
+            results = event_buffer_pointer[0];
+
+            switch (event_handler->evt) {
+            /* Scanned device with no RSSI value */
+            case EVT_INQUIRY_RESULT: {
+                for (results_id = 0; results_id < results; results_id++){
+                    info = (void *)event_buffer_pointer +
+                           (sizeof(*info) * results_id) + 1;
                 }
-                break;
-                /* Scanned device with RSSI value; when within rangle,
-                send message to bluetooth device.
-                */
-                case EVT_INQUIRY_RESULT_WITH_RSSI: {
-
-                    for (results_id = 0; results_id < results; results_id++){
-                        info_rssi = (void *)event_buffer_pointer +
-                                    (sizeof(*info_rssi) * results_id) + 1;
-
-                        if (info_rssi->rssi > g_config.scan_rssi_coverage) {
-                            /* For testing BR scanning parameters
-                            char address[LENGTH_OF_MAC_ADDRESS];
-                            ba2str(&info_rssi->bdaddr, address);
-                            strcat(address, "\0");
-                            zlog_debug(category_debug,
-                                       "Detected device[BR]: %s - RSSI %4d",
-                                       address, info_rssi->rssi);
-                            */            
-                            ba2str(&info_rssi->bdaddr, address);
-                            strcat(address, "\0");                            
-                            
-                            send_to_push_dongle(address,
-                                                BR_EDR,
-                                                info_rssi->rssi,
-                                                is_button_pressed,
-                                                battery_voltage,
-                                                is_payload_needed,
-                                                is_scan_rsp_needed,
-                                                payload,
-                                                payload_length);
-                        }
+            }
+            break;
+            /* Scanned device with RSSI value; when within rangle,
+            send message to bluetooth device.
+            */
+            case EVT_INQUIRY_RESULT_WITH_RSSI: {
+
+                for (results_id = 0; results_id < results; results_id++){
+                    info_rssi = (void *)event_buffer_pointer +
+                                (sizeof(*info_rssi) * results_id) + 1;
+
+                    if (info_rssi->rssi > g_config.scan_rssi_coverage) {
+                        /* For testing BR scanning parameters
+                        char address[LENGTH_OF_MAC_ADDRESS];
+                        ba2str(&info_rssi->bdaddr, address);
+                        strcat(address, "\0");
+                        zlog_debug(category_debug,
+                                   "Detected device[BR]: %s - RSSI %4d",
+                                   address, info_rssi->rssi);
+                        */            
+                        mac_key = convert_bdaddr_to_key(&info_rssi->bdaddr);
+                        init_rssi_stats(&rssi_stats, info_rssi->rssi);
+                        
+                        send_to_push_dongle(mac_key,
+                                            BR_EDR,
+                                            &rssi_stats,
+                                            is_button_pressed,
+                                            battery_voltage,
+                                            is_payload_needed,
+                                            is_scan_rsp_needed,
+                                            payload,
+                                            payload_length,
+                                            read_time_in_us);
                     }
                 }
-                break;
-                /* Stop the scanning process */
-                case EVT_INQUIRY_COMPLETE: {
+            }
+            break;
+            /* Stop the scanning process */
+            case EVT_INQUIRY_COMPLETE: {
 
-                    /* In order to jump out of the while loop. Set
-                    keep_scanning flag to false, new socket will not
-                    be received.
-                    */
-                    keep_scanning = false;
-                }
-                break;
-                default:
-                break;
-                }
+                /* In order to jump out of the while loop. Set
+                keep_scanning flag to false, new socket will not
+                be received.
+                */
+                keep_scanning = false;
+            }
+            break;
+            default:
+            break;
             }
         } //end while
-        close(socket);
+        ht_close(&transport);
 
         zlog_debug(category_debug, "Scanning done of BR devices");
     }//end while
@@ -2664,55 +4281,164 @@ ErrorCode *start_br_scanning(void* param) {
 ErrorCode cleanup_lists(ObjectListHead *list_head, bool is_scanned_list_head){
     struct List_Entry *list_pointer, *save_list_pointers;
     ScannedDevice *temp;
+    int i, generation;
 
-    pthread_mutex_lock(&list_lock);
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
 
-    if(false == is_entry_list_empty(&list_head->list_entry)){
+        pthread_mutex_lock(&device_shards[i].lock);
 
-        list_for_each_safe(list_pointer, save_list_pointers,
-                           &list_head->list_entry){
-            /* If the input list is the scanned list, we should remove the node
-            using sc_list_entry first. Otherwise, we remove the node using
-            tr_list_entry.
-            */
-            if(is_scanned_list_head){
-                temp = ListEntry(list_pointer, ScannedDevice, sc_list_entry);
-                remove_list_node(&temp->sc_list_entry);
-            }else{
-                temp = ListEntry(list_pointer, ScannedDevice, tr_list_entry);
-                remove_list_node(&temp->tr_list_entry);
-            }
+        for(generation = 0 ; generation < NUMBER_GENERATIONS ; generation++){
 
-            /* If the device is of BR_EDR type, each node is linked into both
-            the scanned list and the BR object list using sc_list_entry and
-            tr_list_entry. Make sure the node is removed from both lists.
-            */
-            if(BR_EDR == list_head->device_type){
-                /* BR_EDR case for scanned list head and BR trakced object header
+            list_for_each_safe(list_pointer, save_list_pointers,
+                               &list_head->list_entries[generation][i]){
+                /* If the input list is the scanned list, we should remove the
+                node using sc_list_entry first. Otherwise, we remove the node
+                using tr_list_entry.
                 */
                 if(is_scanned_list_head){
-                    if(false == is_isolated_node(&temp->tr_list_entry)){
-                        remove_list_node(&temp->tr_list_entry);
-                    }
+                    temp = ListEntry(list_pointer, ScannedDevice, 
+                                     sc_list_entry);
+                    remove_list_node(&temp->sc_list_entry);
                 }else{
-                    if(false == is_isolated_node(&temp->sc_list_entry)){
-                        remove_list_node(&temp->sc_list_entry);
+                    temp = ListEntry(list_pointer, ScannedDevice, 
+                                     tr_list_entry);
+                    remove_list_node(&temp->tr_list_entry);
+                }
+
+                /* If the device is of BR_EDR type, each node is linked into 
+                both the scanned list and the BR object list using 
+                sc_list_entry and tr_list_entry. Make sure the node is removed
+                from both lists. Both entries are in the same shard.
+                */
+                if(BR_EDR == list_head->device_type){
+                    /* BR_EDR case for scanned list head and BR trakced object
+                    header
+                    */
+                    if(is_scanned_list_head){
+                        if(false == is_isolated_node(&temp->tr_list_entry)){
+                            remove_list_node(&temp->tr_list_entry);
+                        }
+                    }else{
+                        if(false == is_isolated_node(&temp->sc_list_entry)){
+                            remove_list_node(&temp->sc_list_entry);
+                        }
                     }
+                }else if(BLE == list_head->device_type){
+                    /* BLE case  */
                 }
-            }else if(BLE == list_head->device_type){
-                /* BLE case  */
+                remove_device_hash_table(temp);
+                free_scanned_device(temp);
             }
-            mp_free(&mempool, temp);
         }
+
+        pthread_mutex_unlock(&device_shards[i].lock);
     }
-    pthread_mutex_unlock(&list_lock);
 
     return WORK_SUCCESSFULLY;
 }
 
+int evict_tracked_devices(int max_number_evicted){
+    struct List_Entry *list_pointer, *save_list_pointers;
+    ScannedDevice *temp;
+    float usage;
+    int current_time;
+    int number_evicted = 0;
+    int max_number_evicted_in_shard;
+    int i, j;
+    unsigned int generation;
+    ObjectListHead *lists[] = {&scanned_list_head, &BR_object_list_head,
+                               &BLE_object_list_head};
+
+    /* Start evicting at the high threshold and stop at the low one, so 
+    that eviction does not flap around a single threshold. */
+    usage = max(mp_slots_usage_percentage(&mempool),
+                mp_slots_usage_percentage(&payload_mempool));
+
+    if(usage >= MEMPOOL_USAGE_THRESHOLD){
+
+        if(!is_under_memory_pressure){
+            zlog_info(category_debug,
+                      "Evict least recently seen devices, usage=[%f]", 
+                      usage);
+        }
+        is_under_memory_pressure = true;
+
+    }else if(usage < MEMPOOL_USAGE_LOW_THRESHOLD){
+
+        is_under_memory_pressure = false;
+    }
+
+    current_time = get_system_time();
+
+    /* The devices are spread evenly over the shards, so that evicting the
+    least recently seen devices of each shard approximates a global LRU. */
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
+
+        max_number_evicted_in_shard = 
+            number_evicted + 
+            max(1, max_number_evicted / NUMBER_DEVICE_SHARDS);
+
+        pthread_mutex_lock(&device_shards[i].lock);
+
+        /* Only the active generation of each list is evicted from. The nodes
+        in the frozen generation are being reported. */
+        for(j = 0 ; j < (int) (sizeof(lists) / sizeof(lists[0])) ; j++){
+
+            generation = __atomic_load_n(&lists[j]->active_generation, 
+                                         __ATOMIC_ACQUIRE);
+
+            list_for_each_safe(list_pointer, save_list_pointers, 
+                               &lists[j]->lru_list_entries[generation][i]){
+
+                if(number_evicted >= max_number_evicted_in_shard)
+                    break;
+
+                temp = ListEntry(list_pointer, ScannedDevice, 
+                                 lru_list_entry);
+
+                if(current_time - temp->final_scanned_time > 
+                   MAX_IDLE_TIME_OF_TRACKED_DEVICE_IN_SEC){
+
+                    eviction_stats.number_evicted_by_age++;
+
+                }else if(is_under_memory_pressure){
+
+                    eviction_stats.number_evicted_by_pressure++;
+
+                }else{
+
+                    /* The remaining devices are seen more recently */
+                    break;
+                }
+
+                /* A node is in up to two of the lists besides the hash 
+                table */
+                if(!is_isolated_node(&temp->sc_list_entry))
+                    remove_list_node(&temp->sc_list_entry);
+                if(!is_isolated_node(&temp->tr_list_entry))
+                    remove_list_node(&temp->tr_list_entry);
+
+                remove_device_hash_table(temp);
+                free_scanned_device(temp);
+                number_evicted++;
+            }
+        }
+
+        pthread_mutex_unlock(&device_shards[i].lock);
+    }
+
+    return number_evicted;
+}
+
 ErrorCode *timeout_cleanup(void* param){
+    int last_shrink_time;
+    int current_time;
+    int number_released;
+
     zlog_debug(category_debug, ">> timeout_cleanup... ");
 
+    last_shrink_time = get_system_time();
+
     while(true == ready_to_work){
 
         /* sleep a short time to prevent occupying CPU in this
@@ -2720,16 +4446,25 @@ ErrorCode *timeout_cleanup(void* param){
         */
         sleep_t(BUSY_WAITING_TIME_IN_MS);
 
-        if(mp_slots_usage_percentage(&mempool) >=
-           MEMPOOL_USAGE_THRESHOLD){
+        evict_tracked_devices(MAX_NUMBER_EVICTED_PER_ROUND);
 
-            zlog_info(category_debug,
-                      "cleanup all lists in timeout_cleanup function");
-            cleanup_lists(&scanned_list_head, true);
-            cleanup_lists(&BR_object_list_head, false);
-            cleanup_lists(&BLE_object_list_head, false);
-        }
+        /* Return the slabs left unused after a burst of devices to the OS */
+        current_time = get_system_time();
+
+        if(current_time - last_shrink_time >= MEMPOOL_SHRINK_INTERVAL_IN_SEC){
+
+            last_shrink_time = current_time;
 
+            number_released = 
+                mp_shrink(&mempool, MEMPOOL_SHRINK_IDLE_TIME_IN_SEC) +
+                mp_shrink(&payload_mempool, MEMPOOL_SHRINK_IDLE_TIME_IN_SEC);
+
+            if(number_released > 0){
+                zlog_info(category_health_report,
+                          "Released [%d] unused slabs of the memory pools",
+                          number_released);
+            }
+        }
     }
 
     zlog_debug(category_debug, "<< timeout_cleanup... ");
@@ -2740,7 +4475,8 @@ ErrorCode *timeout_cleanup(void* param){
 ErrorCode cleanup_exit(){
     struct List_Entry *list_pointer, *save_list_pointers;
     struct PrefixRule *temp;
-    struct TempBleDevice *temp_ble_node;
+    struct DeviceNamePrefix *device_name_node;
+    int i;
 
     zlog_debug(category_debug, ">> cleanup_exit... ");
 
@@ -2757,38 +4493,45 @@ ErrorCode cleanup_exit(){
         cleanup_lists(&BR_object_list_head, false);
         cleanup_lists(&BLE_object_list_head, false);
 
-        list_for_each_safe(list_pointer, save_list_pointers,
-                           &g_config.mac_prefix_list_head) {
+        mp_destroy(&mempool);
+        mp_destroy(&payload_mempool);
+    }
 
-            temp = ListEntry(list_pointer, PrefixRule,
-                             list_entry);
-            remove_list_node(&temp->list_entry);
-            mp_free(&mempool, temp);
-        }
+    /* The rules are malloced by get_config, not taken from the memory 
+    pools */
+    list_for_each_safe(list_pointer, save_list_pointers,
+                       &g_config.mac_prefix_list_head) {
 
-        mp_destroy(&mempool);
+        temp = ListEntry(list_pointer, PrefixRule,
+                         list_entry);
+        remove_list_node(&temp->list_entry);
+        free(temp);
     }
-    
-    pthread_mutex_destroy(&list_lock);
-    
-    if(&temp_ble_device_mempool != NULL){
-       
-        zlog_info(category_debug,
-                  "cleanup all lists in cleanup_exit function");
 
-        list_for_each_safe(list_pointer, save_list_pointers,
-                           &temp_ble_device_list_head) {
+    list_for_each_safe(list_pointer, save_list_pointers,
+                       &g_config.device_name_prefix_list_head) {
 
-            temp_ble_node = ListEntry(list_pointer, TempBleDevice,
-                                      list_entry);
-            remove_list_node(&temp_ble_node->list_entry);
-            mp_free(&temp_ble_device_mempool, temp_ble_node);
-        }
-        
-        mp_destroy(&temp_ble_device_mempool);
+        device_name_node = ListEntry(list_pointer, DeviceNamePrefix,
+                                     list_entry);
+        remove_list_node(&device_name_node->list_entry);
+        free(device_name_node);
+    }
+
+    pt_destroy(&g_config.mac_prefix_trie);
+    pt_destroy(&g_config.device_name_prefix_trie);
+    
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
+        pthread_mutex_destroy(&device_shards[i].lock);
     }
+    pthread_mutex_destroy(&known_tag_table.lock);
+    pthread_mutex_destroy(&panic_alert_table.lock);
+    pthread_cond_destroy(&panic_alert_table.new_alert);
     
-    pthread_mutex_destroy(&temp_ble_device_list_lock);
+    /* The scanning and examining threads have stopped using the queues, 
+       since ready_to_work is false. */
+    for(i = 0 ; i < g_config.number_examine_workers ; i++){
+        spsc_destroy(&temp_ble_device_queues[i]);
+    }
 
     Wifi_free();
 
@@ -2829,10 +4572,17 @@ int main(int argc, char **argv) {
     pthread_t ble_scanning_thread;
     pthread_t timer_thread;
     pthread_t communication_thread;
-    pthread_t examine_scanned_ble_thread;
+    pthread_t panic_alert_thread;
+    pthread_t examine_scanned_ble_threads[MAX_NUMBER_EXAMINE_WORKERS];
+    pthread_condattr_t panic_alert_condattr;
     int id = 0;
     int last_join_request_time = 0;
     int current_time;
+    struct List_Entry *list_pointer;
+    struct PrefixRule *mac_prefix_node;
+    uint64_t mac_key;
+    size_t j;
+    int i, generation;
 
     /*Initialize the global flag */
     is_ble_scanning_thread_running = false;
@@ -2881,13 +4631,12 @@ int main(int argc, char **argv) {
         return E_OPEN_FILE;
     }
 
-    /* Initialize the lock for accessing the scanned_list, BR_object_list 
-       and BLE_object_list */
-    pthread_mutex_init(&list_lock,NULL);
+    /* Initialize the shards of the scanned_list, BR_object_list and 
+       BLE_object_list, each with its own lock */
+    for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
+        pthread_mutex_init(&device_shards[i].lock, NULL);
+    }
     
-    /* Initialize the lock for accessing the temp_ble_device_list */
-    pthread_mutex_init(&temp_ble_device_list_lock,NULL);
-
     /* Initialize the memory pool for scanned dvice structs */
     if(MEMORY_POOL_SUCCESS !=
         mp_init(&mempool, 
@@ -2899,28 +4648,142 @@ int main(int argc, char **argv) {
         zlog_error(category_debug,
                    "Error allocating memory pool");
     }
-    
-     /* Initialize the memory pool for temp BLE device structs*/
+
+    /* Initialize the memory pool for the payloads of scanned devices */
     if(MEMORY_POOL_SUCCESS !=
-        mp_init(&temp_ble_device_mempool, 
-                sizeof(struct TempBleDevice), 
-                SLOTS_IN_MEM_POOL_TEMPORARY_BLE_DEVICE)){
+        mp_init(&payload_mempool, 
+                sizeof(struct ScannedPayload), 
+                SLOTS_IN_MEM_POOL_SCANNED_PAYLOAD)){
 
         zlog_error(category_health_report,
-                   "Error allocating memory pool");
+                   "Error allocating payload memory pool");
         zlog_error(category_debug,
-                   "Error allocating memory pool");
+                   "Error allocating payload memory pool");
+    }
+
+    memset(&reported_mempool_stats, 0, sizeof(reported_mempool_stats));
+    memset(&reported_payload_mempool_stats, 0, 
+           sizeof(reported_payload_mempool_stats));
+    reported_mempool_stats_time = get_system_time();
+
+    /* Every field of the structs is set by the examining threads, so that 
+    the slots need not be zeroed */
+    mp_set_zeroing(&mempool, MEMORY_POOL_ZEROING_NONE);
+    mp_set_zeroing(&payload_mempool, MEMORY_POOL_ZEROING_NONE);
+
+    /* The examining threads allocate the structs of the devices and the 
+    communication thread frees them. Let each thread cache free slots to 
+    take the locks of the memory pools once per batch. */
+    mp_enable_thread_cache(&mempool);
+    mp_enable_thread_cache(&payload_mempool);
+    
+    /* Initialize the table of tags learned for the accept list with the 
+       tags given as complete MAC addresses in the config file */
+    memset(&known_tag_table, 0, sizeof(known_tag_table));
+    pthread_mutex_init(&known_tag_table.lock, NULL);
+
+    /* Initialize the table of panic alerts. The sending thread waits on the
+       monotonic clock, the same clock the deadlines of retransmissions are 
+       given in. */
+    memset(&panic_alert_table, 0, sizeof(panic_alert_table));
+    pthread_mutex_init(&panic_alert_table.lock, NULL);
+    pthread_condattr_init(&panic_alert_condattr);
+    pthread_condattr_setclock(&panic_alert_condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&panic_alert_table.new_alert, &panic_alert_condattr);
+    pthread_condattr_destroy(&panic_alert_condattr);
+
+    list_for_each(list_pointer, &g_config.mac_prefix_list_head){
+
+        mac_prefix_node = ListEntry(list_pointer, PrefixRule, list_entry);
+
+        if(NUMBER_DIGITS_OF_MAC_ADDRESS != 
+           mac_prefix_node->mac_prefix.number_digits)
+            continue;
+
+        mac_key = 0;
+        for(j = 0 ; j < sizeof(bdaddr_t) ; j++){
+            mac_key = (mac_key << 8) | mac_prefix_node->mac_prefix.bytes[j];
+        }
+
+        /* The two most significant bits of a static random address are 
+           set */
+        learn_known_tag(mac_key, 
+                        (0x3 == (mac_key >> 46)) ? 
+                        LE_RANDOM_ADDRESS : LE_PUBLIC_ADDRESS, 
+                        true);
+    }
+
+    /* Initialize the statistics of LE advertising report events */
+    memset(&le_advertising_stats, 0, sizeof(le_advertising_stats));
+
+    /* Initialize the cache merging the repeated adverts of the tags */
+    memset(&coalescing_cache, 0, sizeof(coalescing_cache));
+
+    /* Initialize the caches of the advertisers matching no rule */
+    memset(negative_caches, 0, sizeof(negative_caches));
+
+    /* Initialize the queues of temp BLE device structs, one for each 
+    examining thread */
+    for(i = 0 ; i < g_config.number_examine_workers ; i++){
+
+        reported_temp_ble_device_queue_overflow_counts[i] = 0;
+
+        if(SPSC_QUEUE_SUCCESS !=
+            spsc_init(&temp_ble_device_queues[i], 
+                      sizeof(struct TempBleDevice), 
+                      SLOTS_IN_TEMPORARY_BLE_DEVICE_QUEUE)){
+
+            zlog_error(category_health_report,
+                       "Error allocating temp BLE device queue");
+            zlog_error(category_debug,
+                       "Error allocating temp BLE device queue");
+            return E_MALLOC;
+        }
     }
 
-    /*Initialize the global lists */
-    init_entry(&scanned_list_head.list_entry);
+    /*Initialize the global lists and the hash tables indexing them */
+    init_device_hash_table(&scanned_hash_table);
+
+    for(generation = 0 ; generation < NUMBER_GENERATIONS ; generation++){
+
+        init_device_hash_table(&BLE_object_hash_tables[generation]);
+
+        for(i = 0 ; i < NUMBER_DEVICE_SHARDS ; i++){
+            init_entry(&scanned_list_head.list_entries[generation][i]);
+            init_entry(&scanned_list_head.lru_list_entries[generation][i]);
+            init_entry(&BR_object_list_head.list_entries[generation][i]);
+            init_entry(&BR_object_list_head.lru_list_entries[generation][i]);
+            init_entry(&BLE_object_list_head.list_entries[generation][i]);
+            init_entry(&BLE_object_list_head.lru_list_entries[generation][i]);
+        }
+
+        /* The scanned list always stays in its first generation */
+        scanned_list_head.hash_tables[generation] = &scanned_hash_table;
+        BR_object_list_head.hash_tables[generation] = NULL;
+        BLE_object_list_head.hash_tables[generation] = 
+            &BLE_object_hash_tables[generation];
+    }
     scanned_list_head.device_type = BR_EDR;
-    init_entry(&BR_object_list_head.list_entry);
+    scanned_list_head.active_generation = 0;
+    scanned_list_head.next_shard = 0;
     BR_object_list_head.device_type = BR_EDR;
-    init_entry(&BLE_object_list_head.list_entry);
+    BR_object_list_head.active_generation = 0;
+    BR_object_list_head.next_shard = 0;
     BLE_object_list_head.device_type = BLE;
-    
-    init_entry(&temp_ble_device_list_head);
+    BLE_object_list_head.active_generation = 0;
+    BLE_object_list_head.next_shard = 0;
+
+    /* Only BLE devices are reported in the delta reporting mode. A BR_EDR 
+    device is already reported once while it stays in the scanned list. */
+    memset(&reported_state_table, 0, sizeof(reported_state_table));
+    scanned_list_head.reported_states = NULL;
+    BR_object_list_head.reported_states = NULL;
+    BLE_object_list_head.reported_states = 
+        g_config.delta_reporting_enabled ? &reported_state_table : NULL;
+
+    /* Initialize the state of eviction */
+    is_under_memory_pressure = false;
+    memset(&eviction_stats, 0, sizeof(eviction_stats));
     
     /* Register handler function for SIGINT signal */
     sigint_handler.sa_handler = ctrlc_handler;
@@ -2951,17 +4814,22 @@ int main(int argc, char **argv) {
 */
 #endif
 
-    /* Create the thread for track BLE devices */
-    return_value = startThread(&examine_scanned_ble_thread,
-                               examine_scanned_ble_device, NULL);
+    /* Create the threads for track BLE devices, each owning the shards 
+    whose index modulo the number of threads is the index of the thread */
+    for(i = 0 ; i < g_config.number_examine_workers ; i++){
 
-    if(return_value != WORK_SUCCESSFULLY){
-        zlog_error(category_health_report,
-                   "Error creating thread for examine_scanned_ble_device");
-        zlog_error(category_debug,
-                   "Error creating thread for examine_scanned_ble_device");
-        cleanup_exit();
-        exit(return_value);
+        return_value = startThread(&examine_scanned_ble_threads[i],
+                                   examine_scanned_ble_device, 
+                                   (void *) (intptr_t) i);
+
+        if(return_value != WORK_SUCCESSFULLY){
+            zlog_error(category_health_report,
+                       "Error creating thread for examine_scanned_ble_device");
+            zlog_error(category_debug,
+                       "Error creating thread for examine_scanned_ble_device");
+            cleanup_exit();
+            exit(return_value);
+        }
     }
 
     /* Start bluetooth advertising */
@@ -3027,6 +4895,21 @@ int main(int argc, char **argv) {
         zlog_error(category_debug,
                    "Error creating thread for manage_communication");
     }
+
+    /* Create the thread for pushing panic alerts to gateway ahead of the 
+    tracked object data */
+    if(g_config.panic_alert_enabled){
+
+        return_value = startThread(&panic_alert_thread,
+                                   send_panic_alerts, NULL);
+
+        if(return_value != WORK_SUCCESSFULLY){
+            zlog_error(category_health_report,
+                       "Error creating thread for send_panic_alerts");
+            zlog_error(category_debug,
+                       "Error creating thread for send_panic_alerts");
+        }
+    }
     
     gateway_latest_polling_time = 0;
     last_join_request_time = 0;
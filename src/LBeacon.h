@@ -54,6 +54,9 @@ Authors:
 #include <netinet/in.h>
 //#include <obexftp/client.h>
 #include "BeDIS.h"
+#include "HCI_Transport.h"
+#include "Prefix_Trie.h"
+#include "SPSC_Queue.h"
 #include "Version.h"
 
 
@@ -151,18 +154,39 @@ LBeacon sends UDP join_request to the gateway again.
    transient failure. */
 #define DONGLE_GET_RETRY 5
 
-/* Mempool usage threshold for cleaning up all lists. This threshold is used
-to determine whether to cleanup all lists. */
+/* Mempool usage threshold for evicting the least recently seen devices. Once
+the usage reaches this threshold, devices are evicted until the usage drops
+below MEMPOOL_USAGE_LOW_THRESHOLD. */
 #define MEMPOOL_USAGE_THRESHOLD 0.70
 
+/* Mempool usage below which the eviction under memory pressure stops */
+#define MEMPOOL_USAGE_LOW_THRESHOLD 0.60
+
+/* The interval in seconds between the attempts of timeout_cleanup to return
+the unused slabs of the memory pools to the OS */
+#define MEMPOOL_SHRINK_INTERVAL_IN_SEC 60
+
+/* The time in seconds a slab of a memory pool has to stay unused before it is
+returned to the OS, so that the slabs are not released and allocated again 
+between two bursts of devices */
+#define MEMPOOL_SHRINK_IDLE_TIME_IN_SEC 300
+
+/* The maximum number of devices evicted in each round of timeout_cleanup, 
+which bounds the time the shard locks are held for eviction */
+#define MAX_NUMBER_EVICTED_PER_ROUND 64
+
+/* Time in seconds after which a device not seen again is evicted even if it
+has not been reported, e.g. because the gateway stops polling */
+#define MAX_IDLE_TIME_OF_TRACKED_DEVICE_IN_SEC 600
+
 /* Number of characters in the name of a Bluetooth device */
 #define LENGTH_OF_DEVICE_NAME 30
 
 /* Number of characters in the advertising payload of a Bluetooth device */
 #define LENGTH_OF_ADVERTISEMENT 65
 
-/* Number of digits of MAC address to compare */
-#define NUMBER_DIGITS_TO_COMPARE 4
+/* Number of hex digits in a MAC address */
+#define NUMBER_DIGITS_OF_MAC_ADDRESS 12
 
 /* Maximum length in number of bytes of basic info of each response from
 LBeacon to gateway.
@@ -172,56 +196,163 @@ LBeacon to gateway.
 /* Maximum length in number of bytes of device information of each response
 to gateway via wifi network link.*/
 
-/* mac_address;timestamp;timestamp;rssi;button;batt_vol;payload scan_rsp;*/
-#define MAX_LENGTH_RESP_DEVICE_INFO 190
+/* mac_address;timestamp;timestamp;rssi;button;batt_vol;rssi_count;rssi_mean;
+   rssi_ewma;rssi_min;rssi_variance;payload scan_rsp;*/
+#define MAX_LENGTH_RESP_DEVICE_INFO 230
+
+/* The weight of the latest RSSI value in the exponentially weighted moving
+average of the RSSI values of a device */
+#define RSSI_EWMA_WEIGHT 0.25
 
 /* The number of slots in the memory pool for scanned devices */
 #define SLOTS_IN_MEM_POOL_SCANNED_DEVICE 2048
 
-/* The number of slots in the memory pool for temporarily scanned BLE devices */
-#define SLOTS_IN_MEM_POOL_TEMPORARY_BLE_DEVICE 2048
+/* The number of slots in the memory pool for the payloads of scanned 
+devices */
+#define SLOTS_IN_MEM_POOL_SCANNED_PAYLOAD 512
+
+/* The number of slots in the queue of each examining thread for 
+temporarily scanned BLE devices */
+#define SLOTS_IN_TEMPORARY_BLE_DEVICE_QUEUE 2048
+
+/* The number of buckets in the hash tables indexing tracked devices by MAC
+address. It must be a power of two, and is chosen to be larger than the
+number of slots in the memory pool for scanned devices to keep the chains
+short. */
+#define NUMBER_BUCKETS_IN_DEVICE_HASH_TABLE 4096
+
+/* The number of shards the tracked devices are split into by the hash of
+their MAC addresses. Each shard has its own lock, so that devices in different
+shards are updated, reported and evicted in parallel. It must be a power of 
+two, and the bucket of the hash table a device falls into determines its 
+shard. */
+#define NUMBER_DEVICE_SHARDS 4
+
+/* The maximum number of threads examining scanned BLE devices. Each thread
+owns one or more whole device shards, so that there cannot be more threads
+than shards. */
+#define MAX_NUMBER_EXAMINE_WORKERS NUMBER_DEVICE_SHARDS
+
+/* The number of generations of each tracked object list. New devices are
+tracked in the active generation, while the other one is frozen and reported
+to the gateway. */
+#define NUMBER_GENERATIONS 2
+
+/* The multiplier used to spread the 48-bit MAC address key over the hash
+table buckets (the 64-bit golden ratio constant) */
+#define DEVICE_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+/* The maximum number of tags learned for the accept list of the scanning
+dongle. Controllers usually hold far fewer addresses in their accept list,
+in which case the scanning falls back to accepting all devices. */
+#define MAX_NUMBER_KNOWN_TAGS 256
+
+/* The number of slots in the table of known tags. It must be a power of two,
+and is chosen to be twice the maximum number of known tags to keep the probe
+sequences short. */
+#define SLOTS_IN_KNOWN_TAG_TABLE 512
+
+/* Time in seconds a learned tag is kept in the accept list after it is last
+seen */
+#define KNOWN_TAG_TIMEOUT_IN_SEC 600
+
+/* The maximum number of BLE devices whose last reported states are kept for
+the delta reporting. The devices beyond are reported in full every time. */
+#define MAX_NUMBER_REPORTED_DEVICES 1024
+
+/* The number of slots in the table of the last reported states. It must be
+a power of two, and is chosen to be twice the maximum number of devices to 
+keep the probe sequences short. */
+#define SLOTS_IN_REPORTED_STATE_TABLE 2048
+
+/* The maximum number of devices which left reported in one message */
+#define MAX_NUMBER_LEFT_DEVICES_PER_REPORT 64
+
+/* The maximum number of tags with a panic alert pending or being debounced */
+#define MAX_NUMBER_PANIC_ALERTS 64
+
+/* The time in milliseconds before a panic alert not acknowledged by the 
+gateway is sent again for the first time. The interval doubles each time. */
+#define PANIC_ALERT_RETRANSMIT_INTERVAL_IN_MS 200
+
+/* The maximum number of times a panic alert is sent to the gateway */
+#define MAX_NUMBER_PANIC_ALERT_SENDS 8
+
+/* The number of buckets of the histogram of the latencies of panic alerts
+from reading the report to sending the alert. Bucket i counts the latencies
+below 2^i milliseconds, and the last bucket the longer ones. */
+#define NUMBER_PANIC_LATENCY_BUCKETS 12
+
+/* The number of slots in the cache merging the repeated adverts of the tags
+in the BLE scanning thread. It must be a power of two. Two tags falling in
+the same slot evict each other. */
+#define SLOTS_IN_COALESCING_CACHE 1024
+
+/* The number of times per coalescing window the cache is checked for the
+windows which have ended */
+#define COALESCING_CACHE_FLUSHES_PER_WINDOW 4
+
+/* The number of slots in the cache of the advertisers matching no rule, of
+each examining thread. It must be a power of two. Two advertisers falling in
+the same slot evict each other. */
+#define SLOTS_IN_NEGATIVE_CACHE 2048
+
+/* Time in seconds an advertiser is kept in the negative cache */
+#define NEGATIVE_CACHE_TTL_IN_SEC 300
 
 /* The BLE payload identifier indicating no need to parse BLE payload */
-#define BLE_PAYLOAD_IDENTIFIER_NO_PARSE "0000"
+#define BLE_PAYLOAD_IDENTIFIER_NO_PARSE 0x0000
+
+/* The company identifier in a tag decoder indicating no need to check the
+   company of the tag */
+#define TAG_DECODER_ANY_COMPANY_ID 0xFFFF
+
+/* The indexes below are in bytes and count from the length byte of the 0xFF
+AD structure (Manufacture Specific Data) of BLE payload. */
 
 /* The general index of format indetifider in 0xFF field of BLE payload */
-#define BLE_PAYLOAD_FORMAT_INDEX_OF_IDENTIFER 8
+#define BLE_PAYLOAD_FORMAT_INDEX_OF_IDENTIFER 4
+
+/* The index of the company identifier in 0xFF field of BLE payload */
+#define BLE_PAYLOAD_FORMAT_INDEX_OF_COMPANY_ID 2
 
 
 /* The 0xFF format specification for identifier 05C6 */
 /* The BiDaETech button tag with panic and battery voltage identifer 1478 (0x05C6) */
-#define BIDAETECH_TAG_IDENTIFIER_05C6 "05C6" 
+#define BIDAETECH_TAG_IDENTIFIER_05C6 0x05C6 
 
 /* The length of 0xFF field in BLE payload format with identifier 05C6 */
 #define BLE_PAYLOAD_FORMAT_05C6_0XFF_FIELD_LEN 7 
 
-/* The index of panic in BLE payload format with identifer 05C6 */
-#define BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_PANIC 13
+/* The index of the byte whose low nibble is panic in BLE payload format with
+   identifer 05C6 */
+#define BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_PANIC 6
 
 /* The index of voltage information in BLE payload format with identifer 05C6 */
-#define BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_VOLTAGE 14
+#define BLE_PAYLOAD_FORMAT_05C6_INDEX_OF_VOLTAGE 7
 
 
 /* The 0xFF format specification for identifier 05C7 */
 /* The BiDaETech tag identifer 1479 (0x05C7) */
-#define BIDAETECH_TAG_IDENTIFIER_05C7 "05C7" 
+#define BIDAETECH_TAG_IDENTIFIER_05C7 0x05C7 
 
 /* The length of 0xFF field in BLE payload format with identifier 05C7 */
 #define BLE_PAYLOAD_FORMAT_05C7_0XFF_FIELD_LEN 11 
 
-/* The index of voltage information in BLE payload format with identifer 05C6 */
-#define BLE_PAYLOAD_FORMAT_05C7_INDEX_OF_MAC_ADDRESS 12
+/* The index of MAC address in BLE payload format with identifer 05C7 */
+#define BLE_PAYLOAD_FORMAT_05C7_INDEX_OF_MAC_ADDRESS 6
 
 
 /* The 0xFF format specification for identifier 4153 */
 /* The tag with panic identifer 4153 (AS) */
-#define BIDAETECH_TAG_IDENTIFIER_4153 "4153" 
+#define BIDAETECH_TAG_IDENTIFIER_4153 0x4153 
 
 /* The length of 0xFF field in BLE payload format with identifier 4153 */
 #define BLE_PAYLOAD_FORMAT_4153_0XFF_FIELD_LEN 7 
 
-/* The index of panic in BLE payload format with identifer 4153 */
-#define BLE_PAYLOAD_FORMAT_4153_INDEX_OF_PANIC 13
+/* The index of the byte whose low nibble is panic in BLE payload format with
+   identifer 4153 */
+#define BLE_PAYLOAD_FORMAT_4153_INDEX_OF_PANIC 6
 
 
 /* The macro of comparing two integer for minimum */
@@ -230,6 +361,12 @@ to gateway via wifi network link.*/
        __typeof__ (b) _b = (b); \
      _a < _b ? _a : _b; })
 
+/* The macro of comparing two integer for maximum */
+#define max(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+
 /*
   TYPEDEF STRUCTS
 */
@@ -287,6 +424,19 @@ typedef struct Config {
     /* The list of all acceptable device name prefixes */
     struct List_Entry device_name_prefix_list_head;
 
+    /* The trie of all acceptable mac address prefixes compiled from 
+    mac_prefix_list_head. An earlier rule takes precedence. */
+    Prefix_Trie mac_prefix_trie;
+
+    /* The trie of all acceptable device name prefixes compiled from 
+    device_name_prefix_list_head. An earlier rule takes precedence. */
+    Prefix_Trie device_name_prefix_trie;
+
+    /* Whether some device name prefix rule needs the scan responses, in 
+    which case the BLE scanning is active. Otherwise it is passive and no 
+    scan request is sent to the advertisers. */
+    bool is_active_scan_needed;
+
     /* The IPv4 network address of the gateway */
     char gateway_addr[NETWORK_ADDR_LENGTH];
 
@@ -299,6 +449,83 @@ typedef struct Config {
     /* The UDP port for LBeacon to listen and receive UDP from gateway*/
     int local_client_port;
 
+    /* The source of HCI events read by the scanning threads: 0 for the 
+    Bluetooth dongle, 1 for replaying a btsnoop or pcap capture file, and 2
+    for the synthetic generator used in load testing */
+    int scan_hci_transport;
+
+    /* The path name of the capture file replayed by the scanning threads */
+    char scan_hci_replay_file[CONFIG_BUFFER_SIZE];
+
+    /* The number of distinct tags emitted by the synthetic generator */
+    int scan_synthetic_number_tags;
+
+    /* The number of adverts per second emitted by the synthetic generator. 
+    0 means as fast as possible. */
+    int scan_synthetic_adverts_per_second;
+
+    /* Whether the scanning dongle only accepts the adverts of the tags in its
+    accept list. The list is filled in with the tags learned while accepting 
+    all devices. */
+    int scan_accept_list_enabled;
+
+    /* Whether the scanning dongle reports only the first advert of each 
+    device until the scanning is re-armed */
+    int scan_duplicate_filter_enabled;
+
+    /* Time interval in seconds for re-arming the scanning, which refreshes 
+    the accept list and restarts the duplicate filtering */
+    int scan_rearm_interval_in_sec;
+
+    /* Time interval in seconds between two discovery windows, each of which
+    accepts all devices for one re-arm interval to learn the new tags */
+    int scan_discovery_interval_in_sec;
+
+    /* Whether an active scanning alternates short active windows with long
+    passive ones, so that scan responses are still collected from the tags 
+    which need them with fewer scan requests */
+    int scan_hybrid_enabled;
+
+    /* Time interval in seconds of an active window of the hybrid scanning */
+    int scan_hybrid_active_window_in_sec;
+
+    /* Time interval in seconds of a passive window of the hybrid scanning */
+    int scan_hybrid_passive_window_in_sec;
+
+    /* The number of threads examining scanned BLE devices, from 1 to 
+    MAX_NUMBER_EXAMINE_WORKERS */
+    int number_examine_workers;
+
+    /* Whether a BLE device is only reported when it enters, leaves, changes
+    its RSSI band, button or battery state, or its heartbeat is due */
+    int delta_reporting_enabled;
+
+    /* The width in dB of the RSSI bands of the delta reporting */
+    int delta_rssi_band_in_db;
+
+    /* Time interval in seconds a BLE device is reported in full at least
+    once, in the delta reporting mode */
+    int delta_heartbeat_interval_in_sec;
+
+    /* Time in seconds after which a BLE device not seen is reported to have
+    left, in the delta reporting mode */
+    int delta_left_timeout_in_sec;
+
+    /* Whether a pressed button of a tag is pushed to the gateway as a panic
+    alert right away, besides being reported in the tracked object data */
+    int panic_alert_enabled;
+
+    /* Time in seconds the button of a tag must not be seen pressed before
+    a new press raises another panic alert */
+    int panic_debounce_interval_in_sec;
+
+    /* Whether the repeated adverts of a tag are merged by the BLE scanning
+    thread, so that one report per coalescing window is examined */
+    int scan_coalescing_enabled;
+
+    /* Time interval in milliseconds of a coalescing window */
+    int scan_coalescing_window_in_ms;
+
 #ifdef Bluetooth_classic
     /* String representation of the message file name */
     char file_name[CONFIG_BUFFER_SIZE];
@@ -342,23 +569,64 @@ typedef struct ThreadStatus {
 
 } ThreadStatus;
 
+/* Struct for the running statistics of the RSSI values of a device in a
+   report window. It takes constant space no matter how many values are
+   added. */
+typedef struct RssiStats{
+
+    unsigned int count;
+    int8_t min;
+    int8_t max;
+
+    /* The first value added, which the moving average starts from. It is
+       needed to merge the statistics into others. */
+    int8_t first;
+
+    /* The running mean and the sum of squared differences from it, updated
+       by Welford's method */
+    float mean;
+    float m2;
+
+    /* The exponentially weighted moving average */
+    float ewma;
+
+} RssiStats;
+
+/* Struct for the advertising payload and scan response of a scanned device,
+   kept out of the ScannedDevice struct since most rules need neither */
+typedef struct ScannedPayload {
+
+    uint8_t payload[LENGTH_OF_ADVERTISEMENT];
+    uint8_t payload_length;
+    uint8_t scan_rsp[LENGTH_OF_ADVERTISEMENT];
+    uint8_t scan_rsp_length;
+
+} ScannedPayload;
+
 /* Struct for storing MAC address of a Bluetooth device and the time instants
    at which the address is scanned
 */
 typedef struct ScannedDevice {
 
-    char scanned_mac_address[LENGTH_OF_MAC_ADDRESS];
-    int initial_scanned_time;
-    int final_scanned_time;
-    int rssi;
-    int is_button_pressed;
-    int battery_voltage;
-    uint8_t payload[LENGTH_OF_ADVERTISEMENT];
-    size_t payload_length;
+    /* The 48-bit MAC address packed into an integer, used as the key of the
+       device hash table. The string format is rendered only when the device
+       is reported. */
+    uint64_t mac_key;
+    int32_t initial_scanned_time;
+    int32_t final_scanned_time;
+
+    /* The statistics of all the RSSI values in the report window. The 
+       maximum is reported as the RSSI of the device. */
+    RssiStats rssi_stats;
+    uint8_t is_button_pressed;
+    uint8_t battery_voltage;
     bool is_payload_needed;
     bool is_scan_rsp_needed;
-    uint8_t scan_rsp[LENGTH_OF_ADVERTISEMENT];
-    size_t scan_rsp_length;
+
+    /* The advertising payload and scan response, allocated from 
+       payload_mempool only if a rule needs either of them. It is NULL 
+       otherwise. */
+    struct ScannedPayload *payloads;
     
     /* List entries for linking the struct to scanned_list and
        tracked_BR_object_list or to tracked_BLE_object_list, depending
@@ -366,35 +634,178 @@ typedef struct ScannedDevice {
     struct List_Entry sc_list_entry;
     struct List_Entry tr_list_entry;
 
+    /* List entry for linking the struct to a bucket of the device hash table
+       which indexes the list the struct is searched in, i.e., scanned_list
+       for BR_EDR devices and tracked_BLE_object_list for BLE devices. */
+    struct List_Entry ht_list_entry;
+
+    /* List entry for linking the struct to the LRU list of its part of a
+       list, which orders the devices by the time they are last seen, and the
+       head of that LRU list. The entry is isolated while the device is being
+       reported. */
+    struct List_Entry lru_list_entry;
+    struct List_Entry *lru_list_head;
+
 } ScannedDevice;
 
 /* Struct for storing MAC address of a Bluetooth device and the advertising 
-   payload and rssi signal strength
+   payload and rssi signal strength. The structs are the slots of
+   temp_ble_device_queues.
 */
 typedef struct TempBleDevice {
 
-    char scanned_mac_address[LENGTH_OF_MAC_ADDRESS];
+    /* The 48-bit MAC address packed into an integer */
+    uint64_t mac_key;
+
+    /* The address type of the MAC address, public or random */
+    uint8_t bdaddr_type;
     uint8_t evt_type;
     uint8_t payload[LENGTH_OF_ADVERTISEMENT];
     size_t payload_length;
-    int rssi;
-    
-    struct List_Entry list_entry;
+
+    /* The statistics of the RSSI values of the adverts in the report. It
+       holds a single value unless adverts are merged by the coalescing 
+       cache. */
+    RssiStats rssi_stats;
+
+    /* The time in microseconds the report is read from the HCI transport */
+    unsigned long long read_time_in_us;
 
 } TempBleDevice;
 
+/* Struct for the hash table indexing ScannedDevice structs by the integer
+   key of their MAC addresses. Each bucket is the head of a list linked by
+   ht_list_entry of the structs. */
+typedef struct DeviceHashTable{
+
+    struct List_Entry buckets[NUMBER_BUCKETS_IN_DEVICE_HASH_TABLE];
+
+} DeviceHashTable;
+
+/* Struct for the table of the states of the BLE devices last reported to
+   the gateway in the delta reporting mode. The table uses open addressing 
+   with linear probing, and the key 0 marks an empty slot. It is only used
+   by the communication thread, so that it has no lock. */
+typedef struct ReportedStateTable{
+
+    uint64_t mac_key[SLOTS_IN_REPORTED_STATE_TABLE];
+
+    /* The final scanned time of the device when it is last tracked */
+    int last_seen_time[SLOTS_IN_REPORTED_STATE_TABLE];
+
+    /* The time the device is last reported in full */
+    int last_reported_time[SLOTS_IN_REPORTED_STATE_TABLE];
+
+    /* The state last reported. The RSSI band ranges from 0 to 255 when 
+       the band is 1 dB wide. */
+    int rssi_band[SLOTS_IN_REPORTED_STATE_TABLE];
+    uint8_t is_button_pressed[SLOTS_IN_REPORTED_STATE_TABLE];
+    uint8_t battery_voltage[SLOTS_IN_REPORTED_STATE_TABLE];
+
+    int number_devices;
+
+} ReportedStateTable;
+
 /* struct for device list head. */
 typedef struct object_list_head{
 
-    struct List_Entry list_entry;
+    /* The heads of the parts of the list in each generation and device 
+       shard */
+    struct List_Entry list_entries[NUMBER_GENERATIONS][NUMBER_DEVICE_SHARDS];
+
+    /* The heads of the lists ordering the nodes of each part above by the
+       time they are last seen. The least recently seen node is at the 
+       head. */
+    struct List_Entry lru_list_entries[NUMBER_GENERATIONS]
+                                      [NUMBER_DEVICE_SHARDS];
     DeviceType device_type;
 
+    /* The hash tables indexing the nodes of each generation of the list by
+       MAC address, or NULL if the list is not searched by MAC address. */
+    DeviceHashTable *hash_tables[NUMBER_GENERATIONS];
+
+    /* The generation new nodes are inserted into. It is only changed by
+       consolidate_tracked_data(), and is read under the lock of a shard. 
+       The scanned list never changes its generation. */
+    unsigned int active_generation;
+
+    /* The last reported states of the devices in the list, or NULL if the
+       list is not reported in the delta reporting mode. */
+    ReportedStateTable *reported_states;
+
+    /* The shard consolidate_tracked_data() starts from next time. It is
+       where the last message ran out of room, so that no shard starves. */
+    unsigned int next_shard;
+
 } ObjectListHead;
 
+/* Struct for a shard of the tracked devices. The parts of all the lists, 
+   the buckets of the hash tables and the LRU lists of the active generations
+   in a shard are protected by the lock of the shard. */
+typedef struct DeviceShard{
+
+    pthread_mutex_t lock;
+
+} DeviceShard;
+
+/* Struct for the information decoded from the BLE payload of a tag */
+typedef struct TagData{
+
+    int is_button_pressed;
+    int battery_voltage;
+
+    /* The MAC address the tag is reported as. It is the MAC address of the
+       advertiser unless the tag format carries a virtual MAC address. */
+    uint64_t mac_key;
+
+} TagData;
+
+/* Struct for the descriptor of a tag format in the 0xFF field (Manufacture
+   Specific Data) of BLE payload. Supporting a new tag format only requires
+   adding its descriptor to the tag_decoders table in LBeacon.c. */
+typedef struct TagDecoder{
+
+    /* The format identifier in the 0xFF field of BLE payload */
+    uint16_t identifier;
+
+    /* The company identifier required by the format, or 
+       TAG_DECODER_ANY_COMPANY_ID if the company is not checked */
+    uint16_t company_id;
+
+    /* The length of the 0xFF field in the format */
+    uint8_t field_length;
+
+    /* The function extracting the tag information from the 0xFF field. The 
+       field starts from its length byte and has the length above. */
+    void (*decode)(uint8_t *field, TagData *tag_data);
+
+} TagDecoder;
+
+/* Struct for a prefix of bytes given in hex format in the config file. The
+   prefix may end in the middle of a byte. */
+typedef struct HexPrefix{
+
+    uint8_t bytes[LENGTH_OF_ADVERTISEMENT];
+
+    /* The number of hex digits in the prefix */
+    size_t number_digits;
+
+} HexPrefix;
+
 typedef struct PrefixRule{
 
     char prefix[LENGTH_OF_MAC_ADDRESS];
     char identifier[LENGTH_OF_ADVERTISEMENT];
+
+    /* The MAC address prefix without the ':' separators */
+    HexPrefix mac_prefix;
+
+    /* The format identifier in the 0xFF field of BLE payload */
+    uint16_t identifier_value;
+
+    /* The decoder of the tag format, or NULL if the payload is not parsed */
+    TagDecoder *decoder;
+
     struct List_Entry list_entry;
 
 } PrefixRule;
@@ -403,12 +814,212 @@ typedef struct DeviceNamePrefix{
 
     char prefix[LENGTH_OF_ADVERTISEMENT];
     char identifier[LENGTH_OF_ADVERTISEMENT];
+
+    /* The prefix of the complete local name AD structure, starting from its
+       length byte */
+    HexPrefix name_prefix;
+
+    /* The format identifier in the 0xFF field of BLE payload */
+    uint16_t identifier_value;
+
+    /* The decoder of the tag format, or NULL if the payload is not parsed */
+    TagDecoder *decoder;
+
     bool is_payload_needed;
     bool is_scan_rsp_needed;
     struct List_Entry list_entry;
 
 } DeviceNamePrefix;
 
+/* Struct for the statistics of the LE advertising report events read by the
+   BLE scanning thread. The counters are only written by the scanning 
+   thread. */
+typedef struct LeAdvertisingStats{
+
+    /* The number of LE advertising report events */
+    unsigned long number_events;
+
+    /* The number of advertising reports in all the events */
+    unsigned long number_reports;
+
+    /* The maximum number of advertising reports batched in one event */
+    unsigned int max_reports_per_event;
+
+    /* The number of events with a report not fitting in the event */
+    unsigned long number_malformed_events;
+
+    /* The number of adverts merged into the pending report of their tag by
+    the coalescing cache instead of being examined at once */
+    unsigned long number_coalesced_reports;
+
+} LeAdvertisingStats;
+
+/* Struct for a slot of the cache merging the repeated adverts of a tag in
+   the BLE scanning thread */
+typedef struct CoalescedBleDevice{
+
+    /* The merged report, with the RSSI statistics and the latest payload 
+    of the adverts in the window */
+    TempBleDevice report;
+
+    /* Whether the report holds adverts not passed to the examining thread */
+    bool is_pending;
+
+    /* The time in microseconds the current window of the tag starts */
+    unsigned long long window_start_time_in_us;
+
+} CoalescedBleDevice;
+
+/* Struct for the cache merging the repeated adverts of the tags in the BLE
+   scanning thread. The cache is direct-mapped by the MAC address. It is only
+   used by the BLE scanning thread, so that it has no lock. */
+typedef struct CoalescingCache{
+
+    CoalescedBleDevice slots[SLOTS_IN_COALESCING_CACHE];
+
+    /* The time in microseconds the slots are next checked for the windows
+    which have ended */
+    unsigned long long next_flush_time_in_us;
+
+} CoalescingCache;
+
+/* Struct for the cache of the advertisers whose adverts match no rule, keyed
+   by the MAC address and a signature of the payload. The cache is direct-
+   mapped and a slot whose expiry time is 0 is empty. Each examining thread
+   has its own cache, so that it has no lock. */
+typedef struct NegativeCache{
+
+    uint64_t mac_key[SLOTS_IN_NEGATIVE_CACHE];
+    uint32_t signature[SLOTS_IN_NEGATIVE_CACHE];
+
+    /* The time in microseconds of the clock returned by 
+    get_clock_time_in_us() the slot expires */
+    unsigned long long expiry_time_in_us[SLOTS_IN_NEGATIVE_CACHE];
+
+    /* The numbers of adverts found and not found in the cache. They are read
+    by the health report. */
+    unsigned long number_hits;
+    unsigned long number_misses;
+
+} NegativeCache;
+
+/* Struct for the table of the tags learned for the accept list of the
+   scanning dongle. The table uses open addressing with linear probing, and
+   the key 0 marks an empty slot. It is written by the examining thread and
+   read by the BLE scanning thread, under its own lock. */
+typedef struct KnownTagTable{
+
+    uint64_t mac_key[SLOTS_IN_KNOWN_TAG_TABLE];
+    uint8_t bdaddr_type[SLOTS_IN_KNOWN_TAG_TABLE];
+    int last_seen_time[SLOTS_IN_KNOWN_TAG_TABLE];
+
+    /* Whether the tag is given as a complete MAC address in the config file.
+       Such tags never time out. */
+    bool is_configured[SLOTS_IN_KNOWN_TAG_TABLE];
+
+    int number_tags;
+
+    /* Whether a tag was not learned because the table is full */
+    bool is_overflowed;
+
+    pthread_mutex_t lock;
+
+} KnownTagTable;
+
+/* Struct for a panic alert pushed to the gateway when the button of a tag
+   is pressed */
+typedef struct PanicAlert{
+
+    /* The MAC address of the tag, or 0 if the struct is free */
+    uint64_t mac_key;
+
+    /* The sequence number the gateway acknowledges the alert with */
+    unsigned int sequence;
+    int rssi;
+    int battery_voltage;
+
+    /* The time the button is pressed, and the time in seconds it is last
+    seen pressed for debouncing */
+    int pressed_time;
+    int last_pressed_time;
+
+    /* The time in microseconds the report raising the alert is read from
+    the HCI transport */
+    unsigned long long read_time_in_us;
+
+    /* The time in microseconds the alert is to be sent next */
+    unsigned long long next_send_time_in_us;
+    int number_sends;
+
+    /* Whether the alert is acknowledged or given up, so that it is no 
+    longer sent */
+    bool is_done;
+
+} PanicAlert;
+
+/* Struct for the panic alerts and their statistics. It is written by the 
+   threads examining scanned devices, the thread sending the alerts and the
+   communication thread, under its own lock. */
+typedef struct PanicAlertTable{
+
+    PanicAlert alerts[MAX_NUMBER_PANIC_ALERTS];
+
+    /* The sequence number of the next alert */
+    unsigned int next_sequence;
+
+    /* Signaled when an alert is raised */
+    pthread_cond_t new_alert;
+
+    pthread_mutex_t lock;
+
+    unsigned long number_alerts;
+
+    /* The number of pressed buttons seen within the debounce interval */
+    unsigned long number_debounced;
+    unsigned long number_retransmissions;
+    unsigned long number_acked;
+
+    /* The number of alerts not acknowledged after 
+    MAX_NUMBER_PANIC_ALERT_SENDS sends */
+    unsigned long number_given_up;
+
+    /* The number of alerts dropped since the table is full */
+    unsigned long number_dropped;
+
+    unsigned long latency_histogram[NUMBER_PANIC_LATENCY_BUCKETS];
+
+} PanicAlertTable;
+
+/* Struct for the statistics of the devices evicted by timeout_cleanup */
+typedef struct EvictionStats{
+
+    /* The number of devices evicted since they were not seen for 
+       MAX_IDLE_TIME_OF_TRACKED_DEVICE_IN_SEC seconds */
+    unsigned long number_evicted_by_age;
+
+    /* The number of devices evicted under memory pressure */
+    unsigned long number_evicted_by_pressure;
+
+} EvictionStats;
+
+/* Struct for the views of the AD structures in the advertising payload of a
+   BLE device. The pointers refer into the payload and point to the length
+   byte of each AD structure. They are NULL if the AD structure is absent. */
+typedef struct BleAdvertisement{
+
+    /* The complete local name AD structure (0x09) */
+    uint8_t *name_field;
+    size_t name_field_length;
+
+    /* The Manufacture Specific Data AD structure (0xFF) */
+    uint8_t *manufacturer_field;
+    size_t manufacturer_field_length;
+
+    /* The company identifier in the Manufacture Specific Data */
+    uint16_t company_id;
+
+} BleAdvertisement;
+
 
 /*
   EXTERN STRUCTS
@@ -459,26 +1070,76 @@ ObjectListHead BR_object_list_head;
 */
 ObjectListHead BLE_object_list_head;
 
-/* The pthread lock that controls access to lists */
-pthread_mutex_t  list_lock;
+/* Hash table indexing the nodes in scanned_list by MAC address */
+DeviceHashTable scanned_hash_table;
+
+/* Hash tables indexing the nodes in each generation of 
+   tracking_BLE_object_list by MAC address */
+DeviceHashTable BLE_object_hash_tables[NUMBER_GENERATIONS];
+
+/* The shards of the devices in all the lists above, each with its own
+   lock. A device is in the shard selected by get_device_shard_index(). */
+DeviceShard device_shards[NUMBER_DEVICE_SHARDS];
+
+/* Whether timeout_cleanup is evicting devices because the memory pools are
+   short. It is only accessed by timeout_cleanup. */
+bool is_under_memory_pressure;
 
-/* Head of temp_ble_device_list that holds the scanned device information 
-   structsof BLE devices discovered in recent scans. The contents of the list 
-   await to be examined later and added into BLE_object_list if it meets BLE
-   scanning criteria.
+/* The statistics of the devices evicted by timeout_cleanup */
+EvictionStats eviction_stats;
+
+/* The panic alerts raised by pressed buttons of tags */
+PanicAlertTable panic_alert_table;
+
+/* The queues that hold the scanned device information structs of BLE 
+   devices discovered in recent scans, one for each examining thread. The 
+   structs are filled in by the BLE scanning thread and await to be examined
+   by the examining threads and added into BLE_object_list if they meet BLE 
+   scanning criteria. A device always goes into the queue of the thread 
+   owning its shard, so that its structs are examined in order. Each queue
+   has a single producer and a single consumer, so that neither side takes
+   a lock.
 */
-struct List_Entry temp_ble_device_list_head;
+SPSC_Queue temp_ble_device_queues[MAX_NUMBER_EXAMINE_WORKERS];
+
+/* The overflow counts of temp_ble_device_queues reported last time, used to
+   report only the new overflows in the health report. */
+unsigned long 
+    reported_temp_ble_device_queue_overflow_counts[MAX_NUMBER_EXAMINE_WORKERS];
+
+/* The statistics of the LE advertising report events read by the BLE 
+   scanning thread */
+LeAdvertisingStats le_advertising_stats;
 
-/* The pthread lock that controls access to temp_ble_device_list */
-pthread_mutex_t temp_ble_device_list_lock;
+/* The tags learned for the accept list of the scanning dongle */
+KnownTagTable known_tag_table;
+
+/* The cache merging the repeated adverts of the tags in the BLE scanning
+   thread */
+CoalescingCache coalescing_cache;
+
+/* The caches of the advertisers matching no rule, one for each examining
+   thread */
+NegativeCache negative_caches[MAX_NUMBER_EXAMINE_WORKERS];
+
+/* The states of the BLE devices last reported in the delta reporting mode */
+ReportedStateTable reported_state_table;
 
 /* The memory pool for the allocation of all nodes in scanned device list and
    tracked object lists. */
 Memory_Pool mempool;
 
+/* The memory pool for the allocation of the payloads of the nodes which 
+   need them */
+Memory_Pool payload_mempool;
+
+/* The statistics of mempool and payload_mempool last reported in the health
+   report, used to compute the rates since then */
+Memory_Pool_Stats reported_mempool_stats;
+Memory_Pool_Stats reported_payload_mempool_stats;
 
-/* The memory pool for the allocation of all scanned BLE devices */
-Memory_Pool temp_ble_device_mempool;
+/* The time the statistics of the memory pools were last reported */
+int reported_mempool_stats_time;
 
 
 /* Variables for storing the last polling times in second*/\
@@ -569,6 +1230,80 @@ ErrorCode generate_uuid(Config *config);
 
 ErrorCode get_config(Config *config, char *file_name);
 
+/*
+  init_rssi_stats:
+
+      This function starts the RSSI statistics of a device with its first
+      RSSI value.
+
+  Parameters:
+
+      stats - pointer to the statistics to be initialized
+      rssi - the first RSSI value
+
+  Return value:
+
+      None
+*/
+
+void init_rssi_stats(RssiStats *stats, int rssi);
+
+/*
+  merge_rssi_stats:
+
+      This function adds the RSSI values of other statistics to the running
+      statistics of a device, as if the values were added one by one after 
+      the values already in the statistics. The mean and the variance are 
+      combined by the parallel method of Chan et al.
+
+  Parameters:
+
+      stats - pointer to the statistics to be updated
+      other - pointer to the statistics of the RSSI values to be added
+
+  Return value:
+
+      None
+*/
+
+void merge_rssi_stats(RssiStats *stats, RssiStats *other);
+
+/*
+  get_rssi_variance:
+
+      This function returns the sample variance of the RSSI values added to
+      the statistics.
+
+  Parameters:
+
+      stats - pointer to the statistics
+
+  Return value:
+
+      float - the sample variance, or 0 if fewer than two values are added
+*/
+
+float get_rssi_variance(RssiStats *stats);
+
+/*
+  free_scanned_device:
+
+      This function releases a ScannedDevice struct and its payloads back 
+      to the memory pools. The caller holds the lock of the shard of the 
+      struct unless the struct is no longer in an LRU list of the active
+      generation of a list.
+
+  Parameters:
+
+      node - pointer to the struct to be released
+
+  Return value:
+
+      None
+*/
+
+void free_scanned_device(ScannedDevice *node);
+
 /*
   send_to_push_dongle:
 
@@ -579,17 +1314,19 @@ ErrorCode get_config(Config *config, char *file_name);
       struct, this function allocates from memory pool space for a
       ScannedDeivce struct, sets the MAC address of the new struct to the
       input MAC address, the initial scanned time and final scanned time to
-      the current time, and inserts the struct at the head of the scanned_list
+      the time the report is read, and inserts the struct at the head of the scanned_list
       if the device is of BR/EDR type, and tail of the tracked object list
       for the device type. If a struct with MAC address matching the input
       device address is found, this function sets the final scanned time of
-      the struct to the current time.
+      the struct to the time the report is read.
 
   Parameters:
 
-      mac_address - MAC address of a bluetooth device discovered during inquiry
+      mac_key - MAC address of a bluetooth device discovered during inquiry,
+                packed into an integer
       device_type - the indicator to show the device type of the input address
-      rssi - the RSSI value of this device
+      rssi_stats - the statistics of the RSSI values of this device in the 
+                   report
       is_button_pressed - the push_button is pressed
       battery_voltage - the remaining battery voltage
       is_payload_needed - flag indicating whether this device need to upload 
@@ -598,21 +1335,24 @@ ErrorCode get_config(Config *config, char *file_name);
                            ble scan rsp (SCAN_RSP) payload
       payload - the ble payload in decimal format
       payload_length - the length of input payload
+      read_time_in_us - the time in microseconds the report of the device is
+                        read from the HCI transport
 
   Return value:
 
       None
 */
 
-void send_to_push_dongle(char * mac_address,
+void send_to_push_dongle(uint64_t mac_key,
                          DeviceType device_type,
-                         int rssi,
+                         RssiStats *rssi_stats,
                          int is_button_pressed,
                          int battery_voltage,
                          bool is_payload_needed,
                          bool is_scan_rsp_needed,
                          uint8_t *payload,
-                         size_t payload_length);
+                         size_t payload_length,
+                         unsigned long long read_time_in_us);
 /*
   send_to_push_dongle_scan_rsp:
 
@@ -623,7 +1363,8 @@ void send_to_push_dongle(char * mac_address,
 
   Parameters:
 
-      mac_address - MAC address of a bluetooth device discovered during inquiry
+      mac_key - MAC address of a bluetooth device discovered during inquiry,
+                packed into an integer
       device_type - the indicator to show the device type of the input address
       payload - the ble payload in decimal format
       payload_length - the length of input payload
@@ -633,111 +1374,404 @@ void send_to_push_dongle(char * mac_address,
       None
 */
 
-void send_to_push_dongle_scan_rsp(char * mac_address,
+void send_to_push_dongle_scan_rsp(uint64_t mac_key,
                                   DeviceType device_type,
                                   uint8_t *payload,
                                   size_t payload_length);
 
 /*
-  compare_mac_address:
+  convert_mac_address_to_key:
 
-     This function compares two input MAC addresses specified by input
-     parameters
+     This function packs the 48-bit MAC address in the string format
+     "XX:XX:XX:XX:XX:XX" into an integer key.
 
   Parameters:
 
-    address - the MAC address of a bluetooth device
-    node - the node containing the other MAC address to compare
-    number_digits_compared - number of digits in the addresses to be compared
+    mac_address - the MAC address in string format
 
   Return value:
-    0: if the MAC addresses exactly match
+    uint64_t - the 48-bit MAC address in integer format
 
 */
 
-int compare_mac_address(char address[],
-                        ScannedDevice *node,
-                        int number_digits_compared);
-                        
+uint64_t convert_mac_address_to_key(char *mac_address);
+
 /*
-  convert_str_to_mac_address:
+  convert_bdaddr_to_key:
 
-     This function converts char array to MAC address
+     This function packs the 48-bit bluetooth device address into an integer
+     key, in the same order as the string format of the address.
 
   Parameters:
 
-    mac_address_payload - the input buffer contains the mac address in BLE payload 
-    out_buf - the output buffer to store the resulted MAC address
-    
+    bdaddr - the bluetooth device address
+
   Return value:
-    0: if the MAC addresses exactly match
+    uint64_t - the 48-bit MAC address in integer format
 
 */
 
-int convert_str_to_mac_address(char mac_address_payload[],
-                               char *out_buf);
+uint64_t convert_bdaddr_to_key(bdaddr_t *bdaddr);
 
 /*
-  check_is_in_list:
+  convert_key_to_mac_address:
 
-      This function checks whether the MAC address given as input is in the
-      specified list. If a node with MAC address matching the input address
-      is found in the list, the function returns the pointer to the node
-      with matching address; otherwise it returns NULL.
+     This function converts the integer key of a MAC address to the string
+     format "XX:XX:XX:XX:XX:XX".
 
   Parameters:
 
-      address - MAC address of a bluetooth device
-      list_head - the head of a specified list
+    mac_key - the 48-bit MAC address in integer format
+    out_buf - the output buffer of at least LENGTH_OF_MAC_ADDRESS bytes to
+              store the resulted MAC address
 
   Return value:
+    None
 
-  match_node - A pointer to the node found with MAC address identical to
-               the input address.
-               or NULL when no such node is found.
 */
 
-struct ScannedDevice *check_is_in_list(char address[],
-                                       ObjectListHead *list);
+void convert_key_to_mac_address(uint64_t mac_key, char *out_buf);
 
 /*
-  enable_advertising:
+  convert_hex_to_prefix:
 
-      This function enables the LBeacon to start advertising, sets the time
-      interval for advertising, and calibrates the RSSI value.
+     This function converts a prefix in hex format read from the config file
+     to bytes.
 
   Parameters:
 
-      dongle_device_id - the bluetooth dongle device which the LBeacon uses
-                         to advertise
-      advertising_interval_in_units_0625_ms - the time interval in units of 0.625ms 
-                                              during which the LBeacon can advertise
-      advertising_uuid - universally unique identifier of the advertiser
-      major_number - major version number of LBeacon
-      minor_number - minor version number of LBeacon
-      rssi_value - RSSI value of the bluetooth device
+    hex_str - the prefix in hex format
+    prefix - the output struct to store the resulted prefix
 
   Return value:
+    ErrorCode - WORK_SUCCESSFULLY or E_CONFIG_SETTING if the input string is
+                not in hex format or too long
 
-      ErrorCode - The error code for the corresponding error if the function
-                  fails or WORK SUCCESSFULLY otherwise
 */
 
-ErrorCode enable_advertising(int dongle_device_id,
-                             int advertising_interval_in_units_0625_ms,
-                             char *advertising_uuid,
-                             int major_number,
-                             int minor_number,
-                             int rssi_value);
+ErrorCode convert_hex_to_prefix(char *hex_str, HexPrefix *prefix);
 
 /*
-  disable_advertising:
+  get_device_shard_index:
 
-      This function disables advertising of the beacon.
+     This function returns the index of the device shard the MAC address 
+     falls into.
 
   Parameters:
 
-      dongle_device_id - the bluetooth dongle device which the LBeacon needs to
+    mac_key - the integer key of the MAC address
+
+  Return value:
+    unsigned int - the index of the shard in device_shards
+
+*/
+
+unsigned int get_device_shard_index(uint64_t mac_key);
+
+/*
+  is_object_list_empty:
+
+     This function checks whether no device is in any shard or generation
+     of the input list.
+
+  Parameters:
+
+    list - the head of the list to be checked
+
+  Return value:
+    bool - true if the list is empty, false otherwise
+
+*/
+
+bool is_object_list_empty(ObjectListHead *list);
+
+/*
+  init_device_hash_table:
+
+     This function initializes all the buckets of the input hash table.
+
+  Parameters:
+
+    table - the hash table to be initialized
+
+  Return value:
+    None
+
+*/
+
+void init_device_hash_table(DeviceHashTable *table);
+
+/*
+  lookup_device_hash_table:
+
+     This function finds the node with the specified MAC address key in the
+     input hash table. The caller must hold the lock of the shard of the
+     key.
+
+  Parameters:
+
+    table - the hash table to be searched
+    mac_key - the integer key of the MAC address to be found
+
+  Return value:
+    ScannedDevice - A pointer to the node found with the input key, or NULL
+                    when no such node is found.
+
+*/
+
+ScannedDevice *lookup_device_hash_table(DeviceHashTable *table,
+                                        uint64_t mac_key);
+
+/*
+  insert_device_hash_table:
+
+     This function links the input node into the bucket of the hash table
+     selected by the mac_key of the node. The caller must hold the lock of 
+     the shard of the node.
+
+  Parameters:
+
+    table - the hash table into which the node is inserted
+    node - the node to be inserted
+
+  Return value:
+    None
+
+*/
+
+void insert_device_hash_table(DeviceHashTable *table, ScannedDevice *node);
+
+/*
+  remove_device_hash_table:
+
+     This function unlinks the input node from the hash table bucket it is
+     in. Removing a node which is not in any hash table has no effect. The
+     caller must hold the lock of the shard of the node.
+
+  Parameters:
+
+    node - the node to be removed
+
+  Return value:
+    None
+
+*/
+
+void remove_device_hash_table(ScannedDevice *node);
+
+/*
+  check_is_in_list:
+
+      This function checks whether the MAC address given as input is in the
+      specified list by looking up the hash table of the list. If a node with
+      MAC address matching the input address is found in the list, the
+      function returns the pointer to the node with matching address;
+      otherwise it returns NULL. The caller must hold the lock of the shard 
+      of the MAC address, so that the returned node can be updated before 
+      another thread removes it.
+
+  Parameters:
+
+      mac_key - MAC address of a bluetooth device packed into an integer
+      list_head - the head of a specified list
+
+  Return value:
+
+  match_node - A pointer to the node found with MAC address identical to
+               the input address.
+               or NULL when no such node is found.
+*/
+
+struct ScannedDevice *check_is_in_list(uint64_t mac_key,
+                                       ObjectListHead *list);
+
+/*
+  open_hci_transport:
+
+      This function opens the source of HCI events configured for the 
+      scanning threads.
+
+  Parameters:
+
+      transport - pointer to the transport to be opened
+      dongle_device_id - the id of the Bluetooth dongle, used if the events
+                         come from the dongle
+      synthetic_event - the event code generated by the synthetic generator,
+                        either EVT_LE_META_EVENT or 
+                        EVT_INQUIRY_RESULT_WITH_RSSI
+
+  Return value:
+
+      ErrorCode - The error code for the corresponding error if the function
+                  fails or WORK SUCCESSFULLY otherwise
+*/
+
+ErrorCode open_hci_transport(HCI_Transport *transport,
+                             int dongle_device_id,
+                             uint8_t synthetic_event);
+
+/*
+  learn_known_tag:
+
+      This function records a tag in the table of known tags, or refreshes
+      its last seen time if it is already known. The tags in the table are
+      programmed into the accept list of the scanning dongle.
+
+  Parameters:
+
+      mac_key - the MAC address of the tag packed into an integer
+      bdaddr_type - the address type of the MAC address
+      is_configured - whether the tag is given as a complete MAC address in
+                      the config file, in which case it never times out
+
+  Return value:
+
+      None
+*/
+
+void learn_known_tag(uint64_t mac_key, uint8_t bdaddr_type, 
+                     bool is_configured);
+
+/*
+  get_known_tags:
+
+      This function removes the timed out tags from the table of known tags
+      and copies the remaining ones out. It also resets the overflow flag of
+      the table.
+
+  Parameters:
+
+      mac_keys - the array to receive the MAC addresses of the tags, which 
+                 holds MAX_NUMBER_KNOWN_TAGS elements
+      bdaddr_types - the array to receive the address types of the tags,
+                     which holds MAX_NUMBER_KNOWN_TAGS elements
+      is_overflowed - pointer to the flag to receive whether some tags were
+                      not learned since the last call
+
+  Return value:
+
+      int - the number of tags copied out
+*/
+
+int get_known_tags(uint64_t *mac_keys, 
+                   uint8_t *bdaddr_types, 
+                   bool *is_overflowed);
+
+/*
+  is_report_needed:
+
+      This function compares the state of a tracked device with the state 
+      last reported for it, and records the state if the device is to be
+      reported. A device is reported if it is new, changes its RSSI band, 
+      button or battery state, or is not reported in full for 
+      delta_heartbeat_interval_in_sec seconds.
+
+  Parameters:
+
+      table - the table of the last reported states
+      node - the tracked device
+      current_time - the current time in seconds
+
+  Return value:
+
+      bool - true if the device is to be reported in full, false otherwise
+*/
+
+bool is_report_needed(ReportedStateTable *table, 
+                      ScannedDevice *node, 
+                      int current_time);
+
+/*
+  get_left_devices:
+
+      This function removes the devices not seen for 
+      delta_left_timeout_in_sec seconds from the table of the last reported
+      states, and returns their MAC addresses.
+
+  Parameters:
+
+      table - the table of the last reported states
+      current_time - the current time in seconds
+      mac_keys - the array to receive the MAC addresses of the devices
+      max_number_devices - the size of mac_keys. The other devices which 
+                           left are returned next time.
+
+  Return value:
+
+      int - the number of devices which left
+*/
+
+int get_left_devices(ReportedStateTable *table, 
+                     int current_time,
+                     uint64_t *mac_keys, 
+                     int max_number_devices);
+
+/*
+  set_ble_scanning:
+
+      This function (re-)arms the BLE scanning of the dongle. It stops the 
+      scanning, programs the accept list with the known tags if the accept
+      list is enabled and the tags fit in it, sets the scanning parameters 
+      and starts the scanning again with the configured duplicate filtering.
+      It falls back to accepting all devices if the tags do not fit.
+
+  Parameters:
+
+      socket - the HCI socket of the scanning dongle
+      scan_type - 0x00 for passive scanning or 0x01 for active scanning
+      accept_list_size - the number of addresses the accept list of the 
+                         dongle can hold
+      is_discovery - whether to accept all devices to learn the new tags
+
+  Return value:
+
+      ErrorCode - The error code for the corresponding error if the function
+                  fails or WORK SUCCESSFULLY otherwise
+*/
+
+ErrorCode set_ble_scanning(int socket,
+                           int scan_type,
+                           int accept_list_size,
+                           bool is_discovery);
+
+/*
+  enable_advertising:
+
+      This function enables the LBeacon to start advertising, sets the time
+      interval for advertising, and calibrates the RSSI value.
+
+  Parameters:
+
+      dongle_device_id - the bluetooth dongle device which the LBeacon uses
+                         to advertise
+      advertising_interval_in_units_0625_ms - the time interval in units of 0.625ms 
+                                              during which the LBeacon can advertise
+      advertising_uuid - universally unique identifier of the advertiser
+      major_number - major version number of LBeacon
+      minor_number - minor version number of LBeacon
+      rssi_value - RSSI value of the bluetooth device
+
+  Return value:
+
+      ErrorCode - The error code for the corresponding error if the function
+                  fails or WORK SUCCESSFULLY otherwise
+*/
+
+ErrorCode enable_advertising(int dongle_device_id,
+                             int advertising_interval_in_units_0625_ms,
+                             char *advertising_uuid,
+                             int major_number,
+                             int minor_number,
+                             int rssi_value);
+
+/*
+  disable_advertising:
+
+      This function disables advertising of the beacon.
+
+  Parameters:
+
+      dongle_device_id - the bluetooth dongle device which the LBeacon needs to
                          disable advertising function
 
   Return value:
@@ -838,7 +1872,7 @@ ErrorCode handle_tracked_object_data();
   handle_health_report:
 
       This function reads the Health_Report.log and send its content to the
-      gateway.
+      gateway. It also logs the statistics of temp_ble_device_queues.
 
   Parameters:
 
@@ -852,6 +1886,74 @@ ErrorCode handle_tracked_object_data();
 
 ErrorCode handle_health_report();
 
+/*
+  raise_panic_alert:
+
+      This function raises a panic alert for a tag whose button is seen 
+      pressed, unless it is seen pressed within 
+      panic_debounce_interval_in_sec seconds, and wakes up the thread 
+      sending the alerts.
+
+  Parameters:
+
+      mac_key - the MAC address of the tag packed into an integer
+      rssi - the RSSI value of the tag
+      battery_voltage - the remaining battery voltage of the tag
+      read_time_in_us - the time in microseconds the report of the tag is
+                        read from the HCI transport
+
+  Return value:
+
+      None
+*/
+
+void raise_panic_alert(uint64_t mac_key, 
+                       int rssi, 
+                       int battery_voltage,
+                       unsigned long long read_time_in_us);
+
+/*
+  send_panic_alerts:
+
+      This function sends the panic alerts to the gateway as 
+      time_critical_tracked_object_data packets, bypassing the pkt queue of
+      the regular reports. An alert is sent again with a doubling interval
+      until the gateway acknowledges it, at most MAX_NUMBER_PANIC_ALERT_SENDS
+      times. The latency from reading the report to sending the alert the 
+      first time is counted in the latency histogram.
+
+  Parameters:
+
+      param - not used. This parameter is defined to meet the definition of
+              pthread_create() function
+
+  Return value:
+
+      ErrorCode - The error code for the corresponding error if the function
+                  fails or WORK SUCCESSFULLY otherwise
+*/
+
+ErrorCode *send_panic_alerts(void *param);
+
+/*
+  handle_panic_alert_ack:
+
+      This function marks the panic alert acknowledged by the gateway as 
+      done, so that it is no longer sent.
+
+  Parameters:
+
+      resp_content - the content of the acknowledgement, i.e. the sequence
+                     number of the alert
+
+  Return value:
+
+      ErrorCode - The error code for the corresponding error if the function
+                  fails or WORK SUCCESSFULLY otherwise
+*/
+
+ErrorCode handle_panic_alert_ack(char *resp_content);
+
 /*
   manage_communication:
 
@@ -879,7 +1981,17 @@ ErrorCode *manage_communication(void *param);
       This function places the data on tracked objects captured in the
       specifed tracked object list into a message buffer. The output message
       buffer contains for each ScannedDevice struct found in the list, the MAC
-      address and the initial and final timestamps.
+      address, the initial and final timestamps and the statistics of the
+      RSSI values.
+
+      The devices are reported from the frozen generation of the list. Once
+      it has been reported entirely, the generations are swapped, so that the
+      scanning threads track into an empty generation while the frozen one is
+      reported without contending for the locks of the shards.
+
+      If the list has reported_states, only the devices is_report_needed()
+      selects are placed, followed by the number and the MAC addresses of
+      the devices which left.
 
   Parameters:
 
@@ -924,18 +2036,19 @@ const struct hci_request ble_hci_request(uint16_t ocf,
                                          void * cparam);
 
 /*
-  eir_parse_specific_data:
+  parse_ble_advertisement:
 
-      This function parses the sepcific data from bluetooth BLE device
+      This function walks the AD structures in the advertising payload of a
+      bluetooth BLE device once, and fills in the views of the AD structures
+      used to identify tags. The views point into the input payload, so that
+      no data is copied or converted.
 
   Parameters:
 
       eir - the data member of the advertising information result
             from bluetooth BLE scan result
       eir_len - the length in number of bytes of the eir argument
-      eir_type - eir type defined by Bluetooth specifications
-      buf - the output buffer to receive the parsed result
-      buf_len - the length in number of bytes of the buf argument
+      advertisement - the output struct to receive the parsed views
 
   Return value:
 
@@ -943,17 +2056,59 @@ const struct hci_request ble_hci_request(uint16_t ocf,
                   fails or WORK SUCCESSFULLY otherwise
 */
 
-static ErrorCode eir_parse_specific_data(uint8_t *eir,
-                                         size_t eir_len,
-                                         uint8_t eir_type,
-                                         char *buf,
-                                         size_t buf_len);
+ErrorCode parse_ble_advertisement(uint8_t *eir,
+                                  size_t eir_len,
+                                  BleAdvertisement *advertisement);
+
+/*
+  get_tag_decoder:
+
+      This function finds the decoder of a tag format in the table of all
+      supported tag formats. It is called when the config file is loaded,
+      so that each scan rule keeps a pointer to its decoder.
+
+  Parameters:
+
+      identifier - the format identifier in the 0xFF field of BLE payload
+
+  Return value:
+
+      TagDecoder * - the decoder of the tag format or NULL if the format is
+                     not supported
+*/
+
+TagDecoder *get_tag_decoder(uint16_t identifier);
+
+/*
+  decode_tag_data:
+
+      This function decodes the tag information from the BLE payload with
+      the decoder of the scan rule matched by the advertisement.
+
+  Parameters:
+
+      identifier - the format identifier of the matched scan rule
+      decoder - the decoder of the matched scan rule
+      advertisement - the parsed views of the advertising payload
+      tag_data - the output struct to receive the tag information
+
+  Return value:
+
+      bool - true if the advertisement is of the tag format of the rule or
+             the rule does not parse the payload, false otherwise
+*/
+
+bool decode_tag_data(uint16_t identifier,
+                     TagDecoder *decoder,
+                     BleAdvertisement *advertisement,
+                     TagData *tag_data);
 
 /*
   get_printable_ble_payload:
 
       This function change the ble payload from decimal format (non-printable) 
-      to hex format (printable).
+      to hex format (printable). It is called only when the payload is put
+      into a message to the gateway.
 
   Parameters:
 
@@ -978,19 +2133,20 @@ static ErrorCode get_printable_ble_payload(uint8_t *in_buf,
   examine_scanned_ble_device:
 
       This function extracted scanned BLE devices information from the 
-      temp_ble_device_list and compares the scanned attributes with BLE
+      queue of an examining thread in temp_ble_device_queues, i.e. the 
+      devices in the shards owned by the thread, and compares the scanned
+      attributes with BLE
       scanning criteria. To reduce the traffic within BeDIS system, this 
       function only tracks the tags with the specific prefix MAX address. 
       When a tag with specific prefix MAC address is found, this function 
       calls send_to_push_dongle to either add a new ScannedDevice struct 
       of the device to ble_object_list or update the final scan time of a 
       struct in the list.
-      [N.B. This function is executed by the main thread. ]
+      [N.B. This function is executed by number_examine_workers threads. ]
 
   Parameters:
 
-      param - not used. This parameter is defined to meet the definition of
-              pthread_create() function
+      param - the index of the examining thread, cast to a pointer
 
   Return value:
 
@@ -1000,6 +2156,145 @@ static ErrorCode get_printable_ble_payload(uint8_t *in_buf,
 
 ErrorCode *examine_scanned_ble_device(void *param);
 
+/*
+  get_examine_worker_index:
+
+      This function returns the index of the examining thread which owns
+      the shard of the input MAC address.
+
+  Parameters:
+
+      mac_key - the MAC address of a scanned BLE device as a 48-bit key
+
+  Return value:
+
+      unsigned int - the index of the examining thread
+*/
+
+unsigned int get_examine_worker_index(uint64_t mac_key);
+
+/*
+  get_payload_signature:
+
+      This function returns a 32-bit FNV-1a hash of an advertising payload.
+
+  Parameters:
+
+      payload - the advertising payload
+      payload_length - the length of the payload in number of bytes
+
+  Return value:
+
+      uint32_t - the signature of the payload
+*/
+
+uint32_t get_payload_signature(uint8_t *payload, size_t payload_length);
+
+/*
+  is_in_negative_cache:
+
+      This function checks whether an advertiser with the input payload is
+      known to match no rule, and counts the hit or the miss.
+
+  Parameters:
+
+      cache - pointer to the negative cache of the examining thread
+      mac_key - the MAC address of the advertiser as a 48-bit key
+      signature - the signature of the payload
+      current_time_in_us - the current time in microseconds of the clock 
+                           returned by get_clock_time_in_us()
+
+  Return value:
+
+      bool - true if the advertiser is in the cache and not expired
+*/
+
+bool is_in_negative_cache(NegativeCache *cache, 
+                          uint64_t mac_key, 
+                          uint32_t signature,
+                          unsigned long long current_time_in_us);
+
+/*
+  insert_negative_cache:
+
+      This function records that an advertiser with the input payload 
+      matches no rule, for NEGATIVE_CACHE_TTL_IN_SEC seconds.
+
+  Parameters:
+
+      cache - pointer to the negative cache of the examining thread
+      mac_key - the MAC address of the advertiser as a 48-bit key
+      signature - the signature of the payload
+      current_time_in_us - the current time in microseconds of the clock 
+                           returned by get_clock_time_in_us()
+
+  Return value:
+
+      None
+*/
+
+void insert_negative_cache(NegativeCache *cache, 
+                           uint64_t mac_key, 
+                           uint32_t signature,
+                           unsigned long long current_time_in_us);
+
+/*
+  forward_scanned_ble_device:
+
+      This function passes a scanned BLE device to the examining thread
+      owning its shard. The device is dropped if the queue of the thread is
+      full.
+
+  Parameters:
+
+      report - pointer to the report of the scanned BLE device
+
+  Return value:
+
+      None
+*/
+
+void forward_scanned_ble_device(TempBleDevice *report);
+
+/*
+  coalesce_scanned_ble_device:
+
+      This function merges an advert of a tag into the coalescing cache.
+      The first advert of a tag in a coalescing window and an advert whose 
+      payload differs from the previous one are forwarded at once. The other
+      adverts in the window are merged into one report, which is forwarded 
+      when the window ends. Scan responses are always forwarded at once.
+
+  Parameters:
+
+      report - pointer to the report of the scanned BLE device
+
+  Return value:
+
+      None
+*/
+
+void coalesce_scanned_ble_device(TempBleDevice *report);
+
+/*
+  flush_coalescing_cache:
+
+      This function forwards the merged reports of the coalescing windows 
+      which have ended. It only checks the cache a few times per window and
+      returns at once otherwise.
+
+  Parameters:
+
+      current_time_in_us - the current time in microseconds of the clock 
+                           returned by get_clock_time_in_us()
+
+  Return value:
+
+      None
+*/
+
+void flush_coalescing_cache(unsigned long long current_time_in_us);
+
 /*
   start_ble_scanning:
 
@@ -1047,9 +2342,14 @@ ErrorCode cleanup_lists(ObjectListHead *list_head, bool is_scanned_list_head);
 /*
   timeout_cleanup:
 
-      This function is event driven. When it is time to clean up all lists,
-      this function cleans up all scanned list, BR object list, and BLE object
-      list.
+      This function periodically evicts the devices which are not seen for
+      MAX_IDLE_TIME_OF_TRACKED_DEVICE_IN_SEC seconds, and the least recently
+      seen devices while the memory pools are short. Each round evicts at 
+      most MAX_NUMBER_EVICTED_PER_ROUND devices, so that scanning and 
+      reporting are never blocked for long. Every 
+      MEMPOOL_SHRINK_INTERVAL_IN_SEC seconds, it also returns the slabs of 
+      the memory pools left unused for MEMPOOL_SHRINK_IDLE_TIME_IN_SEC seconds
+      to the OS.
 
   Parameters:
 
@@ -1064,6 +2364,25 @@ ErrorCode cleanup_lists(ObjectListHead *list_head, bool is_scanned_list_head);
 
 ErrorCode *timeout_cleanup(void *param);
 
+/*
+  evict_tracked_devices:
+
+      This function evicts the least recently seen devices from the active
+      generations of all the lists. A device is evicted if it is not seen for 
+      MAX_IDLE_TIME_OF_TRACKED_DEVICE_IN_SEC seconds, or while the memory
+      pools are short.
+
+  Parameters:
+
+      max_number_evicted - the maximum number of devices to evict
+
+  Return value:
+
+      int - the number of devices evicted
+*/
+
+int evict_tracked_devices(int max_number_evicted);
+
 /*
   cleanup_exit:
 